@@ -32,6 +32,7 @@
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -47,6 +48,15 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+
+/* Most sectors we ask a disk to transfer per interrupt in READ
+   MULTIPLE and WRITE MULTIPLE, and most sectors one command can
+   transfer. */
+#define MULTIPLE_MAX 16
+#define COMMAND_SECTORS_MAX 256
 
 /* An ATA device. */
 struct disk 
@@ -58,8 +68,12 @@ struct disk
     bool is_ata;                /* 1=This device is an ATA disk. */
     disk_sector_t capacity;     /* Capacity in sectors (if is_ata). */
 
+    int multiple;               /* Sectors per interrupt for READ and
+                                   WRITE MULTIPLE, or 0 if unsupported. */
+
     long long read_cnt;         /* Number of sectors read. */
     long long write_cnt;        /* Number of sectors written. */
+    long long command_cnt;      /* Number of read and write commands. */
   };
 
 /* An ATA channel (aka controller).
@@ -85,11 +99,12 @@ static struct channel channels[CHANNEL_CNT];
 static void reset_channel (struct channel *);
 static bool check_device_type (struct disk *);
 static void identify_ata_device (struct disk *);
+static void set_multiple_mode (struct disk *, int max);
 
-static void select_sector (struct disk *, disk_sector_t);
+static void select_sectors (struct disk *, disk_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
-static void input_sector (struct channel *, void *);
-static void output_sector (struct channel *, const void *);
+static void input_sectors (struct channel *, void *, size_t cnt);
+static void output_sectors (struct channel *, const void *, size_t cnt);
 
 static void wait_until_idle (const struct disk *);
 static bool wait_while_busy (const struct disk *);
@@ -138,8 +153,9 @@ disk_init (void)
 
           d->is_ata = false;
           d->capacity = 0;
+          d->multiple = 0;
 
-          d->read_cnt = d->write_cnt = 0;
+          d->read_cnt = d->write_cnt = d->command_cnt = 0;
         }
 
       /* Register interrupt handler. */
@@ -173,8 +189,8 @@ disk_print_stats (void)
         {
           struct disk *d = disk_get (chan_no, dev_no);
           if (d != NULL && d->is_ata) 
-            printf ("%s: %lld reads, %lld writes\n",
-                    d->name, d->read_cnt, d->write_cnt);
+            printf ("%s: %lld reads, %lld writes, %lld commands\n",
+                    d->name, d->read_cnt, d->write_cnt, d->command_cnt);
         }
     }
 }
@@ -218,46 +234,116 @@ disk_size (struct disk *d)
    per-disk locking is unneeded. */
 void
 disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) 
+{
+  disk_read_multiple (d, sec_no, buffer, 1);
+}
+
+/* Write sector SEC_NO to disk D from BUFFER, which must contain
+   DISK_SECTOR_SIZE bytes.  Returns after the disk has
+   acknowledged receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer)
+{
+  disk_write_multiple (d, sec_no, buffer, 1);
+}
+
+/* Reads the CNT sectors starting at SEC_NO from disk D into
+   BUFFER, which must have room for CNT * DISK_SECTOR_SIZE bytes.
+   Transfers up to COMMAND_SECTORS_MAX sectors per command, with
+   READ MULTIPLE if D supports it, so that the disk interrupts
+   once per block of sectors instead of once per sector.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_read_multiple (struct disk *d, disk_sector_t sec_no, void *buffer,
+                    size_t cnt) 
 {
   struct channel *c;
+  uint8_t *p = buffer;
   
   ASSERT (d != NULL);
   ASSERT (buffer != NULL);
 
   c = d->channel;
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  d->read_cnt++;
+  while (cnt > 0) 
+    {
+      size_t cmd_cnt = cnt < COMMAND_SECTORS_MAX ? cnt : COMMAND_SECTORS_MAX;
+      bool multiple = d->multiple > 0 && cmd_cnt > 1;
+      size_t block = multiple ? (size_t) d->multiple : 1;
+      size_t left;
+
+      select_sectors (d, sec_no, cmd_cnt);
+      issue_pio_command (c, multiple ? CMD_READ_MULTIPLE
+                                     : CMD_READ_SECTOR_RETRY);
+      for (left = cmd_cnt; left > 0; )
+        {
+          size_t n = left < block ? left : block;
+
+          sema_down (&c->completion_wait);
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk read failed, sector=%"PRDSNu,
+                   d->name, sec_no + (cmd_cnt - left));
+          input_sectors (c, p, n);
+          p += n * DISK_SECTOR_SIZE;
+          left -= n;
+        }
+      d->read_cnt += cmd_cnt;
+      d->command_cnt++;
+      sec_no += cmd_cnt;
+      cnt -= cmd_cnt;
+    }
   lock_release (&c->lock);
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   DISK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
+/* Writes the CNT sectors starting at SEC_NO to disk D from
+   BUFFER, which must contain CNT * DISK_SECTOR_SIZE bytes.
+   Returns after the disk has acknowledged receiving the data.
+   Uses WRITE MULTIPLE if D supports it, as disk_read_multiple()
+   uses READ MULTIPLE.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 void
-disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer)
+disk_write_multiple (struct disk *d, disk_sector_t sec_no,
+                     const void *buffer, size_t cnt)
 {
   struct channel *c;
+  const uint8_t *p = buffer;
   
   ASSERT (d != NULL);
   ASSERT (buffer != NULL);
 
   c = d->channel;
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
-  d->write_cnt++;
+  while (cnt > 0) 
+    {
+      size_t cmd_cnt = cnt < COMMAND_SECTORS_MAX ? cnt : COMMAND_SECTORS_MAX;
+      bool multiple = d->multiple > 0 && cmd_cnt > 1;
+      size_t block = multiple ? (size_t) d->multiple : 1;
+      size_t left;
+
+      select_sectors (d, sec_no, cmd_cnt);
+      issue_pio_command (c, multiple ? CMD_WRITE_MULTIPLE
+                                     : CMD_WRITE_SECTOR_RETRY);
+      for (left = cmd_cnt; left > 0; )
+        {
+          size_t n = left < block ? left : block;
+
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk write failed, sector=%"PRDSNu,
+                   d->name, sec_no + (cmd_cnt - left));
+          output_sectors (c, p, n);
+          sema_down (&c->completion_wait);
+          p += n * DISK_SECTOR_SIZE;
+          left -= n;
+        }
+      d->write_cnt += cmd_cnt;
+      d->command_cnt++;
+      sec_no += cmd_cnt;
+      cnt -= cmd_cnt;
+    }
   lock_release (&c->lock);
 }
 
@@ -381,7 +467,7 @@ identify_ata_device (struct disk *d)
       d->is_ata = false;
       return;
     }
-  input_sector (c, id);
+  input_sectors (c, id, 1);
 
   /* Calculate capacity. */
   d->capacity = id[60] | ((uint32_t) id[61] << 16);
@@ -402,6 +488,36 @@ identify_ata_device (struct disk *d)
   printf ("\", serial \"");
   print_ata_string ((char *) &id[10], 20);
   printf ("\"\n");
+
+  /* Word 47 gives the most sectors the disk can transfer per
+     interrupt with READ and WRITE MULTIPLE, or 0. */
+  set_multiple_mode (d, id[47] & 0xff);
+}
+
+/* Enables READ and WRITE MULTIPLE on disk D, which can transfer
+   at most MAX sectors per interrupt, with the largest power of 2
+   up to MAX and MULTIPLE_MAX.  Leaves them disabled if MAX is
+   less than 2 or D rejects the command. */
+static void
+set_multiple_mode (struct disk *d, int max) 
+{
+  struct channel *c = d->channel;
+  int block;
+
+  if (max > MULTIPLE_MAX)
+    max = MULTIPLE_MAX;
+  for (block = 1; block * 2 <= max; block *= 2)
+    continue;
+  if (block < 2)
+    return;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), block);
+  issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  if ((inb (reg_alt_status (c)) & STA_ERR) == 0)
+    d->multiple = block;
 }
 
 /* Prints STRING, which consists of SIZE bytes in a funky format:
@@ -426,18 +542,19 @@ print_ata_string (char *string, size_t size)
 }
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the count CNT, at most COMMAND_SECTORS_MAX, to
+   the disk's sector selection registers.  (We use LBA mode.) */
 static void
-select_sector (struct disk *d, disk_sector_t sec_no) 
+select_sectors (struct disk *d, disk_sector_t sec_no, size_t cnt) 
 {
   struct channel *c = d->channel;
 
-  ASSERT (sec_no < d->capacity);
-  ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= COMMAND_SECTORS_MAX);
+  ASSERT (sec_no + cnt <= d->capacity);
+  ASSERT (sec_no + cnt <= (1UL << 28));
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt % 256);   /* 0 means 256. */
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -458,20 +575,21 @@ issue_pio_command (struct channel *c, uint8_t command)
   outb (reg_command (c), command);
 }
 
-/* Reads a sector from channel C's data register in PIO mode into
-   SECTOR, which must have room for DISK_SECTOR_SIZE bytes. */
+/* Reads CNT sectors from channel C's data register in PIO mode
+   into SECTORS, which must have room for CNT * DISK_SECTOR_SIZE
+   bytes. */
 static void
-input_sector (struct channel *c, void *sector) 
+input_sectors (struct channel *c, void *sectors, size_t cnt) 
 {
-  insw (reg_data (c), sector, DISK_SECTOR_SIZE / 2);
+  insw (reg_data (c), sectors, cnt * DISK_SECTOR_SIZE / 2);
 }
 
-/* Writes SECTOR to channel C's data register in PIO mode.
-   SECTOR must contain DISK_SECTOR_SIZE bytes. */
+/* Writes CNT sectors from SECTORS to channel C's data register in
+   PIO mode.  SECTORS must contain CNT * DISK_SECTOR_SIZE bytes. */
 static void
-output_sector (struct channel *c, const void *sector) 
+output_sectors (struct channel *c, const void *sectors, size_t cnt) 
 {
-  outsw (reg_data (c), sector, DISK_SECTOR_SIZE / 2);
+  outsw (reg_data (c), sectors, cnt * DISK_SECTOR_SIZE / 2);
 }
 
 /* Low-level ATA primitives. */
@@ -7,6 +7,7 @@
 #include "threads/io.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/tsc.h"
   
 /* See [8254] for hardware details of the 8254 timer chip. */
 //test comment//
@@ -17,9 +18,55 @@
 #error TIMER_FREQ <= 1000 recommended
 #endif
 
+/* PIT input frequency, in Hz, and the count that divides it
+   down to TIMER_FREQ, rounded to nearest. */
+#define PIT_FREQ 1193180
+#define PIT_TICK_COUNT ((PIT_FREQ + TIMER_FREQ / 2) / TIMER_FREQ)
+
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
+/* Tickless idle.  While the idle thread halts, timer_idle_enter()
+   switches the PIT from periodic mode to a one-shot that fires
+   at the next tick anything is due, skipping the interrupts in
+   between.  The one-shot is aligned with the periodic tick
+   boundaries, so tickless_ticks ticks have passed when it fires.
+   A 16-bit PIT count limits a one-shot to a few ticks. */
+static int tickless_ticks;      /* Ticks the one-shot covers, or 0. */
+static uint16_t tickless_count; /* Count the one-shot started from. */
+static uint16_t tickless_first; /* Counts to the first boundary. */
+
+/* Threads sleeping in timer_sleep(), in ascending order of the
+   tick at which they should wake up.  A sleeping thread is
+   blocked, so its `elem' is free to link it into this list. */
+static struct list sleep_list;
+
+/* Hierarchical timer wheel for timers armed with timer_add().
+   Level L has WHEEL_SIZE slots, each covering WHEEL_SIZE**L
+   ticks.  A timer is placed at the lowest level whose span
+   reaches its expiry.  Every tick runs one level-0 slot; each
+   time a level's slot index wraps to 0, the current slot of the
+   next level up is "cascaded" down into the lower levels.  So
+   adding, canceling and expiring a timer are all O(1), and each
+   timer is cascaded at most WHEEL_LEVELS - 1 times.  Timers
+   beyond the top level's span are parked in its farthest slot
+   and re-placed each time it comes around. */
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4
+#define WHEEL_SPAN ((int64_t) 1 << (WHEEL_BITS * WHEEL_LEVELS))
+static struct list wheel[WHEEL_LEVELS][WHEEL_SIZE];
+static int64_t wheel_ticks;     /* Next tick whose level-0 slot is due. */
+static int armed_cnt;           /* # of timers in the wheel. */
+
+/* Statistics. */
+static long long sleep_cnt;     /* # of calls to timer_sleep() that slept. */
+static long long wakeup_ticks;  /* # of ticks that woke up a thread. */
+static long long expired_cnt;   /* # of timer callbacks run. */
+static uint64_t intr_cycles;    /* Cycles spent in timer interrupts. */
+static long long avoided_cnt;   /* # of interrupts skipped while idle. */
+
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
@@ -28,6 +75,15 @@ static intr_handler_func timer_interrupt;
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
+static bool wakeup_less (const struct list_elem *, const struct list_elem *,
+                         void *);
+static void wheel_insert (struct timer *);
+static int wheel_cascade (int level);
+static void wheel_run (void);
+static int64_t wheel_next_due (int64_t limit);
+static void pit_program (uint8_t mode, uint16_t count);
+static uint16_t pit_read_count (void);
+static bool pit_output (void);
 
 /* Sets up the 8254 Programmable Interval Timer (PIT) to
    interrupt PIT_FREQ times per second, and registers the
@@ -35,13 +91,13 @@ static void real_time_sleep (int64_t num, int32_t denom);
 void
 timer_init (void) 
 {
-  /* 8254 input frequency divided by TIMER_FREQ, rounded to
-     nearest. */
-  uint16_t count = (1193180 + TIMER_FREQ / 2) / TIMER_FREQ;
+  int level, slot;
 
-  outb (0x43, 0x34);    /* CW: counter 0, LSB then MSB, mode 2, binary. */
-  outb (0x40, count & 0xff);
-  outb (0x40, count >> 8);
+  pit_program (2, PIT_TICK_COUNT);
+  list_init (&sleep_list);
+  for (level = 0; level < WHEEL_LEVELS; level++)
+    for (slot = 0; slot < WHEEL_SIZE; slot++)
+      list_init (&wheel[level][slot]);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
 
@@ -91,14 +147,25 @@ timer_elapsed (int64_t then)
   return timer_ticks () - then;
 }
 
-/* Suspends execution for approximately TICKS timer ticks. */
+/* Suspends execution for approximately TICKS timer ticks.  The
+   thread blocks on the sleep list, so it costs nothing until
+   timer_interrupt() wakes it up. */
 void
 timer_sleep (int64_t ticks) 
 {
-  int64_t start = timer_ticks ();
+  struct thread *t = thread_current ();
+  enum intr_level old_level;
+
   ASSERT (intr_get_level () == INTR_ON);
-  while (timer_elapsed (start) < ticks) 
-    thread_yield ();
+  if (ticks <= 0)
+    return;
+
+  old_level = intr_disable ();
+  t->wakeup_tick = timer_ticks () + ticks;
+  list_insert_ordered (&sleep_list, &t->elem, wakeup_less, NULL);
+  sleep_cnt++;
+  thread_block ();
+  intr_set_level (old_level);
 }
 
 /* Suspends execution for approximately MS milliseconds. */
@@ -127,14 +194,344 @@ void
 timer_print_stats (void) 
 {
   printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
+  printf ("Timer: %lld sleeps, %lld ticks woke sleepers\n",
+          sleep_cnt, wakeup_ticks);
+  printf ("Timer: %lld callbacks, %"PRIu64" cycles in interrupts\n",
+          expired_cnt, timer_interrupt_cycles ());
+  printf ("Timer: %lld interrupts avoided by tickless idle\n", avoided_cnt);
+}
+
+/* Called by the idle thread, with interrupts off, just before it
+   halts.  If nothing is due for a few ticks, reprograms the PIT
+   to interrupt only when the next thing is due: the first
+   sleeping thread's wakeup, an armed timer, or (for the MLFQS)
+   the next once-a-second update. */
+void
+timer_idle_enter (void) 
+{
+  uint16_t first;
+  int64_t deadline;
+  int max_ticks;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (tickless_ticks != 0)
+    return;
+
+  /* Longest one-shot that fits in 16 bits, starting from the
+     current point in this tick. */
+  first = pit_read_count ();
+  max_ticks = 1 + (0xffff - first) / PIT_TICK_COUNT;
+
+  deadline = wheel_next_due (ticks + max_ticks);
+  if (!list_empty (&sleep_list))
+    {
+      struct thread *t = list_entry (list_front (&sleep_list),
+                                     struct thread, elem);
+      if (t->wakeup_tick < deadline)
+        deadline = t->wakeup_tick;
+    }
+  if (thread_mlfqs && (ticks / TIMER_FREQ + 1) * TIMER_FREQ < deadline)
+    deadline = (ticks / TIMER_FREQ + 1) * TIMER_FREQ;
+  if (deadline - ticks < 2)
+    return;
+
+  tickless_ticks = deadline - ticks;
+  tickless_first = first;
+  tickless_count = first + (tickless_ticks - 1) * PIT_TICK_COUNT;
+  pit_program (0, tickless_count);
+}
+
+/* Called with interrupts off whenever the idle thread is
+   scheduled out.  If it was woken from a tickless halt by some
+   interrupt other than the timer's, brings the tick count up to
+   date and rearms the PIT to interrupt at the next tick
+   boundary, where timer_interrupt() returns to periodic mode. */
+void
+timer_idle_exit (void) 
+{
+  uint16_t elapsed;
+  int passed;
+  uint16_t next;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* Nothing to do in periodic mode, when the one-shot already
+     runs to the next boundary, or when it already fired and
+     timer_interrupt() is pending. */
+  if (tickless_ticks < 2 || pit_output ())
+    return;
+
+  elapsed = tickless_count - pit_read_count ();
+  if (elapsed < tickless_first)
+    {
+      passed = 0;
+      next = tickless_first - elapsed;
+    }
+  else
+    {
+      passed = 1 + (elapsed - tickless_first) / PIT_TICK_COUNT;
+      next = PIT_TICK_COUNT - (elapsed - tickless_first) % PIT_TICK_COUNT;
+    }
+
+  ticks += passed;
+  avoided_cnt += passed;
+  thread_add_idle_ticks (passed);
+
+  tickless_ticks = 1;
+  tickless_first = tickless_count = next;
+  pit_program (0, next);
+}
+
+/* Arms timer T to call FUNCTION, passing AUX, once TICKS timer
+   ticks have elapsed (or at the next tick, if TICKS <= 0).
+   FUNCTION runs in interrupt context after the timer interrupt
+   has been acknowledged, so it may not sleep; it may re-arm T.
+   T must not already be armed.
+
+   This function may be called from an interrupt handler. */
+void
+timer_add (struct timer *t, int64_t ticks, timer_func *function, void *aux)
+{
+  enum intr_level old_level;
+
+  ASSERT (t != NULL);
+  ASSERT (function != NULL);
+
+  old_level = intr_disable ();
+  ASSERT (!t->armed);
+  t->expires = timer_ticks () + (ticks > 0 ? ticks : 1);
+  t->function = function;
+  t->aux = aux;
+  t->armed = true;
+  wheel_insert (t);
+  armed_cnt++;
+  intr_set_level (old_level);
+}
+
+/* Disarms timer T.  Returns true if T was armed, false if it had
+   already expired or been canceled.
+
+   This function may be called from an interrupt handler. */
+bool
+timer_cancel (struct timer *t)
+{
+  enum intr_level old_level;
+  bool was_armed;
+
+  ASSERT (t != NULL);
+
+  old_level = intr_disable ();
+  was_armed = t->armed;
+  if (was_armed)
+    {
+      list_remove (&t->elem);
+      t->armed = false;
+      armed_cnt--;
+    }
+  intr_set_level (old_level);
+
+  return was_armed;
+}
+
+/* Returns the number of CPU cycles spent so far handling timer
+   interrupts, including running expired timers. */
+uint64_t
+timer_interrupt_cycles (void)
+{
+  enum intr_level old_level = intr_disable ();
+  uint64_t cycles = intr_cycles;
+  intr_set_level (old_level);
+
+  return cycles;
 }
 
-/* Timer interrupt handler. */
+/* Timer interrupt handler.  Wakes up every thread whose sleep
+   has expired; since the sleep list is sorted, only the expired
+   threads and the first unexpired one are examined. */
 static void
 timer_interrupt (struct intr_frame *args UNUSED)
 {
-  ticks++;
-  thread_tick ();
+  uint64_t start = rdtsc ();
+  bool woke = false;
+  int elapsed = 1;
+
+  /* Back from a tickless one-shot: account for every tick it
+     covered and resume periodic interrupts. */
+  if (tickless_ticks != 0)
+    {
+      elapsed = tickless_ticks;
+      avoided_cnt += elapsed - 1;
+      tickless_ticks = 0;
+      pit_program (2, PIT_TICK_COUNT);
+    }
+
+  while (elapsed-- > 0)
+    {
+      ticks++;
+      thread_tick ();
+    }
+
+  while (!list_empty (&sleep_list))
+    {
+      struct thread *t = list_entry (list_front (&sleep_list),
+                                     struct thread, elem);
+      if (t->wakeup_tick > ticks)
+        break;
+      list_pop_front (&sleep_list);
+      thread_unblock (t);
+      woke = true;
+    }
+  if (woke)
+    wakeup_ticks++;
+
+  /* Leave the timer wheel to the bottom half, unless it is empty,
+     in which case there is nothing to cascade or run. */
+  if (armed_cnt > 0)
+    intr_defer (wheel_run);
+  else
+    wheel_ticks = ticks + 1;
+
+  intr_cycles += rdtsc () - start;
+}
+
+/* Places armed timer T into the timer wheel slot where it
+   belongs, relative to wheel_ticks. */
+static void
+wheel_insert (struct timer *t)
+{
+  int64_t delta = t->expires - wheel_ticks;
+  int64_t expires = t->expires;
+  int level;
+
+  if (delta < 0)
+    {
+      /* Already due: run it with the next slot. */
+      list_push_back (&wheel[0][wheel_ticks & WHEEL_MASK], &t->elem);
+      return;
+    }
+  if (delta >= WHEEL_SPAN)
+    expires = wheel_ticks + WHEEL_SPAN - 1;
+
+  for (level = 0; level < WHEEL_LEVELS - 1; level++)
+    if (expires - wheel_ticks < (int64_t) 1 << (WHEEL_BITS * (level + 1)))
+      break;
+  list_push_back (&wheel[level][(expires >> (WHEEL_BITS * level))
+                                & WHEEL_MASK],
+                  &t->elem);
+}
+
+/* Moves each timer in the current slot of LEVEL down to the
+   level where it now belongs.  Returns the index of the slot. */
+static int
+wheel_cascade (int level)
+{
+  int index = (wheel_ticks >> (WHEEL_BITS * level)) & WHEEL_MASK;
+  struct list *slot = &wheel[level][index];
+
+  while (!list_empty (slot))
+    wheel_insert (list_entry (list_pop_front (slot), struct timer, elem));
+  return index;
+}
+
+/* Timer interrupt bottom half.  Runs every timer due up to and
+   including the current tick. */
+static void
+wheel_run (void)
+{
+  uint64_t start = rdtsc ();
+
+  while (wheel_ticks <= ticks)
+    {
+      int index = wheel_ticks & WHEEL_MASK;
+      struct list *slot = &wheel[0][index];
+      struct list expired;
+      int level;
+
+      /* Cascade each level whose lower levels just wrapped. */
+      for (level = 1; index == 0 && level < WHEEL_LEVELS; level++)
+        index = wheel_cascade (level);
+
+      /* Take the slot's timers before running any, so that a
+         callback that re-arms its timer 64 ticks out does not
+         land back in the slot being emptied. */
+      list_init (&expired);
+      if (!list_empty (slot))
+        list_splice (list_end (&expired), list_begin (slot), list_end (slot));
+      wheel_ticks++;
+
+      while (!list_empty (&expired))
+        {
+          struct timer *t = list_entry (list_pop_front (&expired),
+                                        struct timer, elem);
+          t->armed = false;
+          armed_cnt--;
+          expired_cnt++;
+          t->function (t->aux);
+        }
+    }
+
+  intr_cycles += rdtsc () - start;
+}
+
+/* Returns the first tick before LIMIT at which the timer wheel
+   has work to do, that is, a timer to run or a level to cascade,
+   or LIMIT if there is none. */
+static int64_t
+wheel_next_due (int64_t limit)
+{
+  int64_t t;
+
+  if (armed_cnt == 0)
+    return limit;
+  for (t = wheel_ticks; t < limit; t++)
+    if ((t & WHEEL_MASK) == 0 || !list_empty (&wheel[0][t & WHEEL_MASK]))
+      return t;
+  return limit;
+}
+
+/* Programs PIT counter 0 to operate in MODE (0 for a one-shot
+   interrupt, 2 for periodic interrupts) with the given COUNT. */
+static void
+pit_program (uint8_t mode, uint16_t count) 
+{
+  /* CW: counter 0, LSB then MSB, MODE, binary. */
+  outb (0x43, 0x30 | (mode << 1));
+  outb (0x40, count & 0xff);
+  outb (0x40, count >> 8);
+}
+
+/* Returns the current value of PIT counter 0. */
+static uint16_t
+pit_read_count (void) 
+{
+  uint8_t lsb, msb;
+
+  outb (0x43, 0x00);    /* CW: counter 0, latch count. */
+  lsb = inb (0x40);
+  msb = inb (0x40);
+  return lsb | (msb << 8);
+}
+
+/* Returns the state of PIT counter 0's output, which in mode 0
+   goes high when the one-shot's count runs out. */
+static bool
+pit_output (void) 
+{
+  outb (0x43, 0xe2);    /* Read-back: counter 0, status only. */
+  return (inb (0x40) & 0x80) != 0;
+}
+
+/* Returns true if the sleeping thread for list element A_ should
+   wake up before the one for B_. */
+static bool
+wakeup_less (const struct list_elem *a_, const struct list_elem *b_,
+             void *aux UNUSED)
+{
+  const struct thread *a = list_entry (a_, struct thread, elem);
+  const struct thread *b = list_entry (b_, struct thread, elem);
+
+  return a->wakeup_tick < b->wakeup_tick;
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
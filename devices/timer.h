@@ -1,7 +1,9 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <list.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
@@ -18,6 +20,26 @@ void timer_msleep (int64_t milliseconds);
 void timer_usleep (int64_t microseconds);
 void timer_nsleep (int64_t nanoseconds);
 
+/* A timer armed with timer_add().  The caller owns the storage,
+   which must be zeroed before its first use and stay valid until
+   the timer expires or is canceled. */
+typedef void timer_func (void *aux);
+struct timer
+  {
+    struct list_elem elem;      /* Element in a timer wheel slot. */
+    int64_t expires;            /* Tick at which to call FUNCTION. */
+    timer_func *function;       /* Function to call. */
+    void *aux;                  /* Auxiliary data for FUNCTION. */
+    bool armed;                 /* Added and not yet expired or canceled? */
+  };
+
+void timer_add (struct timer *, int64_t ticks, timer_func *, void *aux);
+bool timer_cancel (struct timer *);
+uint64_t timer_interrupt_cycles (void);
+
+void timer_idle_enter (void);
+void timer_idle_exit (void);
+
 void timer_print_stats (void);
 
 #endif /* devices/timer.h */
@@ -0,0 +1,119 @@
+/* exit-bench.c
+
+   Measures how long a process with many resident pages takes to
+   exit, which is dominated by freeing its frames.
+
+   Usage: exit-bench [PAGES]
+
+   Runs a child that touches PAGES pages (default 12000, at most
+   MAX_PAGES) of a large array, so that they are all resident,
+   records the time stamp counter in a file and exits.  The
+   parent reports the cycles from that time stamp to its wait()
+   returning.
+
+   The pages must all fit in the user pool without swapping, or
+   the benchmark measures eviction instead.  The user pool gets
+   half of free memory, less with "-ul", so the default needs
+   "pintos -m 128".  The child checks the pool with memstat() and
+   refuses to run if it is too small. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "threads/tsc.h"
+
+#define PAGE_SIZE 4096
+#define MAX_PAGES 32768
+#define DEFAULT_PAGES 12000
+
+/* Free user pages to leave over, for the pageout daemon's
+   watermarks and the child's stack and other pages. */
+#define SPARE_PAGES 64
+#define STAMP_FILE "exit-bench.tsc"
+
+static char pages[MAX_PAGES][PAGE_SIZE];
+
+/* Touches the first PAGE_CNT pages, saves the time stamp counter
+   in STAMP_FILE and exits. */
+static int
+child (int page_cnt)
+{
+  struct memstat stats;
+  uint64_t stamp;
+  int i, fd;
+
+  if (!memstat (&stats))
+    return EXIT_FAILURE;
+  if ((uint32_t) page_cnt + SPARE_PAGES > stats.user.free_pages)
+    {
+      printf ("exit-bench: %d pages would not fit in the %u free user "
+              "pages; give Pintos more memory\n",
+              page_cnt, (unsigned) stats.user.free_pages);
+      return EXIT_FAILURE;
+    }
+
+  for (i = 0; i < page_cnt; i++)
+    pages[i][0] = 1;
+
+  fd = open (STAMP_FILE);
+  if (fd < 0)
+    return EXIT_FAILURE;
+  stamp = rdtsc ();
+  write (fd, &stamp, sizeof stamp);
+  close (fd);
+  return EXIT_SUCCESS;
+}
+
+int
+main (int argc, char *argv[])
+{
+  char cmd[64];
+  int page_cnt = DEFAULT_PAGES;
+  uint64_t stamp, end;
+  pid_t pid;
+  int fd;
+
+  if (argc > 1)
+    page_cnt = atoi (argv[1]);
+  if (page_cnt < 0 || page_cnt > MAX_PAGES)
+    {
+      printf ("exit-bench: PAGES must be between 0 and %d\n", MAX_PAGES);
+      return EXIT_FAILURE;
+    }
+  if (argc > 2 && !strcmp (argv[2], "child"))
+    return child (page_cnt);
+
+  remove (STAMP_FILE);
+  if (!create (STAMP_FILE, sizeof stamp))
+    {
+      printf ("exit-bench: create failed\n");
+      return EXIT_FAILURE;
+    }
+
+  snprintf (cmd, sizeof cmd, "exit-bench %d child", page_cnt);
+  pid = exec (cmd);
+  if (pid == PID_ERROR || wait (pid) != EXIT_SUCCESS)
+    {
+      printf ("exit-bench: child failed\n");
+      return EXIT_FAILURE;
+    }
+  end = rdtsc ();
+
+  fd = open (STAMP_FILE);
+  if (fd < 0 || read (fd, &stamp, sizeof stamp) != sizeof stamp)
+    {
+      printf ("exit-bench: cannot read time stamp\n");
+      return EXIT_FAILURE;
+    }
+  close (fd);
+  remove (STAMP_FILE);
+
+  printf ("exit with %d resident pages: %llu cycles", page_cnt,
+          (unsigned long long) (end - stamp));
+  if (page_cnt > 0)
+    printf (", %llu per page",
+            (unsigned long long) ((end - stamp) / page_cnt));
+  printf ("\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,59 @@
+/* free.c
+
+   Prints the kernel's memory statistics, like Unix "free": the
+   pages in each page allocator pool, and the blocks in each
+   kernel malloc() size class.
+
+   Pool sizes are in kB.  "Peak" is the most memory ever in use
+   at once, which is a good guide for choosing the "-ul" user page
+   limit, and "zeroed" is free memory already cleared for reuse.
+   "Frag" is the percentage of the memory handed out by malloc()
+   that went to rounding requests up to the block size. */
+
+#include <stdio.h>
+#include <syscall.h>
+
+#define PAGE_KB 4
+
+static void
+print_pool (const char *name, const struct memstat_pool *p)
+{
+  printf ("%-6s %8d %8d %8d %8d %8d %8d\n", name,
+          (int) p->total_pages * PAGE_KB, (int) p->used_pages * PAGE_KB,
+          (int) p->free_pages * PAGE_KB, (int) p->peak_pages * PAGE_KB,
+          (int) p->zeroed_pages * PAGE_KB, (int) p->failures);
+}
+
+int
+main (void)
+{
+  struct memstat stats;
+  unsigned i;
+
+  if (!memstat (&stats))
+    {
+      printf ("free: memstat failed\n");
+      return EXIT_FAILURE;
+    }
+
+  printf ("%-6s %8s %8s %8s %8s %8s %8s\n",
+          "", "total", "used", "free", "peak", "zeroed", "failures");
+  print_pool ("Kernel", &stats.kernel);
+  print_pool ("User", &stats.user);
+
+  printf ("\n%6s %8s %8s %8s %8s\n", "Block", "arenas", "live", "free",
+          "frag%");
+  for (i = 0; i < stats.class_cnt; i++)
+    {
+      const struct memstat_class *c = &stats.classes[i];
+      int frag = 0;
+
+      if (c->allocated_bytes != 0)
+        frag = (c->allocated_bytes - c->requested_bytes) * 100
+               / c->allocated_bytes;
+      printf ("%6d %8d %8d %8d %8d\n", (int) c->block_size,
+              (int) c->arenas, (int) c->live_blocks, (int) c->free_blocks,
+              frag);
+    }
+  return EXIT_SUCCESS;
+}
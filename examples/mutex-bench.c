@@ -0,0 +1,46 @@
+/* mutex-bench.c
+
+   Compares the cost of locking and unlocking an uncontended
+   futex-based mutex, which stays in user space, with the cost of
+   a lock that makes a system call to acquire and another to
+   release, as a lock implemented in the kernel would. */
+
+#include <mutex.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "threads/tsc.h"
+
+#define ITER_CNT 10000
+
+int
+main (void)
+{
+  struct mutex mutex;
+  int dummy = 0;
+  uint64_t start, mutex_cycles, syscall_cycles;
+  int i;
+
+  mutex_init (&mutex);
+  start = rdtsc ();
+  for (i = 0; i < ITER_CNT; i++)
+    {
+      mutex_lock (&mutex);
+      mutex_unlock (&mutex);
+    }
+  mutex_cycles = rdtsc () - start;
+
+  /* futex_wake() on a futex with no waiters does nothing but
+     enter and leave the kernel. */
+  start = rdtsc ();
+  for (i = 0; i < ITER_CNT; i++)
+    {
+      futex_wake (&dummy, 1);
+      futex_wake (&dummy, 1);
+    }
+  syscall_cycles = rdtsc () - start;
+
+  printf ("mutex lock+unlock: %d cycles\n", (int) (mutex_cycles / ITER_CNT));
+  printf ("system call lock+unlock: %d cycles\n",
+          (int) (syscall_cycles / ITER_CNT));
+  return EXIT_SUCCESS;
+}
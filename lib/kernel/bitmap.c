@@ -289,6 +289,28 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt)
 
 /* Finding set or unset bits. */
 
+/* Finds and returns the index of the first bit in B at or after
+   START that is set to VALUE, skipping a whole element at a time
+   where none of its bits match.
+   If there is no such bit, returns BITMAP_ERROR. */
+static size_t
+scan_one (const struct bitmap *b, size_t start, bool value)
+{
+  elem_type skip = value ? 0 : (elem_type) -1;
+  size_t i = start;
+
+  while (i < b->bit_cnt)
+    {
+      if (i % ELEM_BITS == 0 && b->bits[elem_idx (i)] == skip)
+        i += ELEM_BITS;
+      else if (bitmap_test (b, i) == value)
+        return i;
+      else
+        i++;
+    }
+  return BITMAP_ERROR;
+}
+
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
@@ -299,7 +321,9 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
-  if (cnt <= b->bit_cnt) 
+  if (cnt == 1)
+    return scan_one (b, start, value);
+  else if (cnt <= b->bit_cnt) 
     {
       size_t last = b->bit_cnt - cnt;
       size_t i;
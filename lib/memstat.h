@@ -0,0 +1,42 @@
+#ifndef __LIB_MEMSTAT_H
+#define __LIB_MEMSTAT_H
+
+#include <stdint.h>
+
+/* Maximum number of malloc() size classes reported. */
+#define MEMSTAT_CLASS_MAX 10
+
+/* Statistics for one page allocator pool, in pages. */
+struct memstat_pool
+  {
+    uint32_t total_pages;               /* Pages in the pool. */
+    uint32_t used_pages;                /* Pages allocated. */
+    uint32_t free_pages;                /* Pages available. */
+    uint32_t peak_pages;                /* Most pages ever allocated. */
+    uint32_t zeroed_pages;              /* Free pages already zeroed. */
+    uint32_t failures;                  /* Allocations that failed. */
+  };
+
+/* Statistics for one malloc() size class. */
+struct memstat_class
+  {
+    uint32_t block_size;                /* Size of each block, in bytes. */
+    uint32_t arenas;                    /* Pages holding blocks. */
+    uint32_t live_blocks;               /* Blocks allocated. */
+    uint32_t free_blocks;               /* Blocks on the free list. */
+    uint64_t requested_bytes;           /* Bytes ever requested. */
+    uint64_t allocated_bytes;           /* Bytes ever handed out. */
+  };
+
+/* Kernel memory statistics, as reported by the memstat system
+   call.  The internal fragmentation of a size class is the part
+   of ALLOCATED_BYTES that was not in REQUESTED_BYTES. */
+struct memstat
+  {
+    struct memstat_pool kernel;         /* Kernel pool. */
+    struct memstat_pool user;           /* User pool. */
+    uint32_t class_cnt;                 /* Number of CLASSES in use. */
+    struct memstat_class classes[MEMSTAT_CLASS_MAX];
+  };
+
+#endif /* lib/memstat.h */
@@ -28,7 +28,14 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_GETUSAGE,               /* Reports this thread's CPU usage. */
+    SYS_SETTICKETS,             /* Sets this thread's CPU share. */
+    SYS_FUTEX_WAIT,             /* Sleeps if a futex has a value. */
+    SYS_FUTEX_WAKE,             /* Wakes threads sleeping on a futex. */
+    SYS_MEMSTAT                 /* Reports kernel memory statistics. */
   };
 
 #endif /* lib/syscall-nr.h */
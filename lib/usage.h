@@ -0,0 +1,16 @@
+#ifndef __LIB_USAGE_H
+#define __LIB_USAGE_H
+
+#include <stdint.h>
+
+/* CPU usage of a thread, as reported by the getusage system
+   call. */
+struct usage
+  {
+    int64_t run_ticks;                  /* Timer ticks spent running. */
+    uint64_t run_cycles;                /* TSC cycles spent running. */
+    unsigned voluntary_switches;        /* Switches while blocking. */
+    unsigned involuntary_switches;      /* Switches while still runnable. */
+  };
+
+#endif /* lib/usage.h */
@@ -0,0 +1,72 @@
+#include <mutex.h>
+#include <syscall.h>
+
+/* Atomically sets *P to NEW if it equals OLD.  Returns the value
+   *P had. */
+static inline int
+compare_exchange (int *p, int old, int new)
+{
+  int prev;
+  asm volatile ("lock cmpxchgl %2, %1"
+                : "=a" (prev), "+m" (*p)
+                : "r" (new), "0" (old)
+                : "memory");
+  return prev;
+}
+
+/* Atomically sets *P to NEW and returns the value it had. */
+static inline int
+exchange (int *p, int new)
+{
+  asm volatile ("xchgl %0, %1"
+                : "+r" (new), "+m" (*p)
+                :
+                : "memory");
+  return new;
+}
+
+/* Initializes MUTEX as unlocked. */
+void
+mutex_init (struct mutex *mutex)
+{
+  mutex->state = 0;
+}
+
+/* Locks MUTEX, sleeping until it is available if necessary.  The
+   mutex is not recursive. */
+void
+mutex_lock (struct mutex *mutex)
+{
+  int state = compare_exchange (&mutex->state, 0, 1);
+  if (state == 0)
+    return;
+
+  /* Contended: mark the mutex as having waiters, then sleep until
+     we are the one to change it from unlocked.  We cannot tell
+     whether other waiters remain, so we take it in the
+     has-waiters state, which costs at most a spurious wake. */
+  if (state != 2)
+    state = exchange (&mutex->state, 2);
+  while (state != 0)
+    {
+      futex_wait (&mutex->state, 2);
+      state = exchange (&mutex->state, 2);
+    }
+}
+
+/* Locks MUTEX if it is available, without sleeping.  Returns true
+   if successful, false if MUTEX is already locked. */
+bool
+mutex_trylock (struct mutex *mutex)
+{
+  return compare_exchange (&mutex->state, 0, 1) == 0;
+}
+
+/* Unlocks MUTEX, which the caller must have locked, waking a
+   waiter if there might be one. */
+void
+mutex_unlock (struct mutex *mutex)
+{
+  if (exchange (&mutex->state, 0) == 2)
+    futex_wake (&mutex->state, 1);
+}
@@ -0,0 +1,28 @@
+#ifndef __LIB_USER_MUTEX_H
+#define __LIB_USER_MUTEX_H
+
+#include <stdbool.h>
+
+/* A mutex built on futexes.  Locking and unlocking an
+   uncontended mutex takes a single atomic instruction each and
+   makes no system call; only a thread that must wait, and the
+   thread that wakes it, enter the kernel.
+
+   The mutex's state is a futex:
+     0: unlocked.
+     1: locked, no waiters.
+     2: locked, possibly with waiters. */
+struct mutex
+  {
+    int state;
+  };
+
+/* Initializer for a mutex with static storage duration. */
+#define MUTEX_INITIALIZER { 0 }
+
+void mutex_init (struct mutex *);
+void mutex_lock (struct mutex *);
+bool mutex_trylock (struct mutex *);
+void mutex_unlock (struct mutex *);
+
+#endif /* lib/user/mutex.h */
@@ -182,3 +182,33 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+bool
+getusage (struct usage *usage)
+{
+  return syscall1 (SYS_GETUSAGE, usage);
+}
+
+bool
+settickets (int tickets)
+{
+  return syscall1 (SYS_SETTICKETS, tickets);
+}
+
+int
+futex_wait (int *addr, int expected)
+{
+  return syscall2 (SYS_FUTEX_WAIT, addr, expected);
+}
+
+int
+futex_wake (int *addr, int n)
+{
+  return syscall2 (SYS_FUTEX_WAKE, addr, n);
+}
+
+bool
+memstat (struct memstat *stats)
+{
+  return syscall1 (SYS_MEMSTAT, stats);
+}
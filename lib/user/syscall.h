@@ -3,6 +3,8 @@
 
 #include <stdbool.h>
 #include <debug.h>
+#include <memstat.h>
+#include <usage.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -45,4 +47,11 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+bool getusage (struct usage *);
+bool settickets (int tickets);
+int futex_wait (int *addr, int expected);
+int futex_wake (int *addr, int n);
+bool memstat (struct memstat *);
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,97 @@
+/* Arms 10,000 timers with timer_add(), spread randomly over the
+   next 5 seconds, cancels every tenth one, and checks that every
+   remaining timer fires exactly once and never early.
+
+   Also reports the average cost of a timer interrupt, in CPU
+   cycles per tick, with no timers armed and with the timers
+   armed, which shows that the cost of a tick does not grow with
+   the number of armed timers. */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <random.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define TIMER_CNT 10000
+#define MAX_DELAY (5 * TIMER_FREQ)
+
+struct wheel_timer
+  {
+    struct timer timer;         /* The timer. */
+    int fire_cnt;               /* # of times it has fired. */
+  };
+
+static timer_func wheel_timer_func;
+static int early_cnt;
+
+static uint64_t cycles_per_tick (int64_t ticks);
+
+void
+test_alarm_wheel (void)
+{
+  struct wheel_timer *timers;
+  uint64_t idle_cycles, armed_cycles;
+  int i;
+
+  timers = calloc (TIMER_CNT, sizeof *timers);
+  if (timers == NULL)
+    fail ("couldn't allocate %d timers", TIMER_CNT);
+
+  idle_cycles = cycles_per_tick (TIMER_FREQ);
+
+  msg ("Arming %d timers...", TIMER_CNT);
+  early_cnt = 0;
+  for (i = 0; i < TIMER_CNT; i++)
+    timer_add (&timers[i].timer, random_ulong () % MAX_DELAY + 1,
+               wheel_timer_func, &timers[i]);
+  for (i = 0; i < TIMER_CNT; i += 10)
+    if (!timer_cancel (&timers[i].timer) && timers[i].fire_cnt == 0)
+      fail ("timer %d neither armed nor fired", i);
+
+  armed_cycles = cycles_per_tick (MAX_DELAY + TIMER_FREQ);
+
+  for (i = 0; i < TIMER_CNT; i++)
+    {
+      if (timers[i].timer.armed)
+        fail ("timer %d still armed", i);
+      if (timers[i].fire_cnt > 1)
+        fail ("timer %d fired %d times", i, timers[i].fire_cnt);
+      if (i % 10 != 0 && timers[i].fire_cnt != 1)
+        fail ("timer %d never fired", i);
+    }
+  if (early_cnt > 0)
+    fail ("%d timers fired early", early_cnt);
+  free (timers);
+
+  msg ("No timers armed: %"PRIu64" cycles per tick.", idle_cycles);
+  msg ("%d timers armed: %"PRIu64" cycles per tick.",
+       TIMER_CNT, armed_cycles);
+  pass ();
+}
+
+/* Sleeps for TICKS timer ticks and returns the average number of
+   cycles spent in each timer interrupt meanwhile. */
+static uint64_t
+cycles_per_tick (int64_t ticks)
+{
+  int64_t start_ticks = timer_ticks ();
+  uint64_t start_cycles = timer_interrupt_cycles ();
+
+  timer_sleep (ticks);
+  return ((timer_interrupt_cycles () - start_cycles)
+          / (timer_elapsed (start_ticks)));
+}
+
+static void
+wheel_timer_func (void *wt_)
+{
+  struct wheel_timer *wt = wt_;
+
+  if (timer_ticks () < wt->timer.expires)
+    early_cnt++;
+  wt->fire_cnt++;
+}
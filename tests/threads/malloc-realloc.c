@@ -0,0 +1,104 @@
+/* Checks that realloc() keeps a block in place when the new size
+   still fits, and counts how often a growing big block is
+   extended in place, as a growing buffer would be.
+
+   A small block that is shrunk, or grown within its size class,
+   must keep its address.  A big block is then grown one page at
+   a time to GROW_PAGES pages and shrunk back, checking at each
+   step that its contents survive; whether it can grow in place
+   depends on what else is allocated, so that count is only
+   reported. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "threads/vaddr.h"
+
+#define GROW_PAGES 32
+
+static void fill (unsigned char *, size_t size);
+static void check (const unsigned char *, size_t size);
+
+void
+test_malloc_realloc (void)
+{
+  unsigned char *p;
+  uintptr_t old;
+  size_t size;
+  int in_place = 0, moved = 0;
+
+  /* Small blocks. */
+  p = malloc (100);
+  ASSERT (p != NULL);
+  fill (p, 100);
+  old = (uintptr_t) p;
+  p = realloc (p, 60);
+  if ((uintptr_t) p != old)
+    fail ("shrinking a 100-byte block moved it");
+  p = realloc (p, 120);
+  if ((uintptr_t) p != old)
+    fail ("growing a 100-byte block to 120 bytes moved it");
+  check (p, 60);
+  free (p);
+
+  /* Big block, grown a page at a time. */
+  size = PGSIZE;
+  p = malloc (size);
+  ASSERT (p != NULL);
+  fill (p, size);
+  while (size < GROW_PAGES * PGSIZE)
+    {
+      size += PGSIZE;
+      old = (uintptr_t) p;
+      p = realloc (p, size);
+      if (p == NULL)
+        fail ("realloc to %zu bytes failed", size);
+      check (p, size - PGSIZE);
+      if ((uintptr_t) p == old)
+        in_place++;
+      else
+        moved++;
+      fill (p, size);
+    }
+  msg ("Grew a big block to %d pages: %d times in place, %d moved.",
+       GROW_PAGES, in_place, moved);
+
+  /* Shrinking a big block never moves it. */
+  while (size > PGSIZE)
+    {
+      size -= PGSIZE;
+      old = (uintptr_t) p;
+      p = realloc (p, size);
+      if ((uintptr_t) p != old)
+        fail ("shrinking a big block to %zu bytes moved it", size);
+      check (p, size);
+    }
+  free (p);
+
+  pass ();
+}
+
+/* Fills the SIZE bytes at P with a pattern that check() can
+   verify. */
+static void
+fill (unsigned char *p, size_t size)
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    p[i] = i % 251;
+}
+
+/* Fails unless the SIZE bytes at P have the pattern written by
+   fill(). */
+static void
+check (const unsigned char *p, size_t size)
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    if (p[i] != i % 251)
+      fail ("byte %zu of block changed", i);
+}
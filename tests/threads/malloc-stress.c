@@ -0,0 +1,115 @@
+/* Runs THREAD_CNT threads that each perform ITER_CNT random
+   malloc() and free() calls on a small working set of blocks of
+   a few sizes, and reports the combined rate in operations per
+   second.
+
+   Each thread writes its own tag into every block it allocates
+   and checks it before freeing the block, so the test fails if
+   two live blocks overlap.  The rate is informational. */
+
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define THREAD_CNT 8
+#define ITER_CNT 20000
+#define SLOT_CNT 16
+
+static const size_t block_sizes[] = {16, 60, 100, 200};
+
+struct stress_data
+  {
+    int id;                     /* Thread number, used as tag. */
+    unsigned seed;              /* Pseudo-random number state. */
+    struct semaphore *done;     /* Upped when finished. */
+  };
+
+static thread_func stress_thread;
+
+void
+test_malloc_stress (void)
+{
+  struct stress_data data[THREAD_CNT];
+  struct semaphore done;
+  int64_t start, ticks;
+  long long op_cnt = (long long) THREAD_CNT * ITER_CNT;
+  int i;
+
+  msg ("%d threads will each do %d mallocs and frees.",
+       THREAD_CNT, ITER_CNT);
+
+  sema_init (&done, 0);
+  start = timer_ticks ();
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "stress %d", i);
+      data[i].id = i;
+      data[i].seed = i + 1;
+      data[i].done = &done;
+      thread_create (name, PRI_DEFAULT, stress_thread, &data[i]);
+    }
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_down (&done);
+  ticks = timer_elapsed (start);
+  if (ticks == 0)
+    ticks = 1;
+
+  msg ("%lld operations in %lld ticks: %lld operations per second.",
+       op_cnt, (long long) ticks, op_cnt * TIMER_FREQ / ticks);
+  pass ();
+}
+
+/* Returns a pseudo-random number from D's private generator. */
+static unsigned
+next_random (struct stress_data *d)
+{
+  d->seed = d->seed * 1103515245 + 12345;
+  return d->seed >> 16;
+}
+
+static void
+stress_thread (void *d_)
+{
+  struct stress_data *d = d_;
+  unsigned char *slots[SLOT_CNT];
+  size_t sizes[SLOT_CNT];
+  int i;
+
+  memset (slots, 0, sizeof slots);
+  for (i = 0; i < ITER_CNT; i++)
+    {
+      int slot = next_random (d) % SLOT_CNT;
+
+      if (slots[slot] == NULL)
+        {
+          size_t size = block_sizes[next_random (d)
+                                    % (sizeof block_sizes
+                                       / sizeof *block_sizes)];
+          slots[slot] = malloc (size);
+          if (slots[slot] == NULL)
+            fail ("thread %d: malloc of %zu bytes failed", d->id, size);
+          sizes[slot] = size;
+          memset (slots[slot], d->id, size);
+        }
+      else
+        {
+          size_t j;
+
+          for (j = 0; j < sizes[slot]; j++)
+            if (slots[slot][j] != d->id)
+              fail ("thread %d: block overwritten", d->id);
+          free (slots[slot]);
+          slots[slot] = NULL;
+        }
+    }
+
+  for (i = 0; i < SLOT_CNT; i++)
+    free (slots[i]);
+  sema_up (d->done);
+}
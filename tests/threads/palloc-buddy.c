@@ -0,0 +1,152 @@
+/* Measures the cost of allocating and freeing multi-page blocks
+   with the buddy page allocator at several levels of
+   fragmentation, and compares it with the cost of the same
+   operations on a bitmap searched first-fit, as the page
+   allocator used to do.
+
+   The test first takes every free page in the kernel pool, one
+   at a time, then frees a pseudo-random subset, keeping
+   FRAG_LEVELS[] percent of them allocated.  A bitmap, created
+   beforehand while memory is available, gets the same pattern of
+   used and free pages.  Then each allocator satisfies and
+   immediately frees ITER_CNT requests of 1 to 8 pages.
+
+   The test fails if an allocation overlaps a page that is still
+   held, or if an allocation fails with no fragmentation at
+   all. */
+
+#include <bitmap.h>
+#include <inttypes.h>
+#include <random.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/tsc.h"
+#include "threads/vaddr.h"
+
+#define HELD_PAGES 8                    /* Pages in the HELD array. */
+#define HELD_MAX (HELD_PAGES * PGSIZE / sizeof (void *))
+#define ITER_CNT 1000
+
+static const int frag_levels[] = {0, 50, 90};
+static const size_t request_sizes[] = {1, 2, 3, 4, 5, 8};
+
+static bool still_held (void **held, size_t held_cnt, const bool *keep,
+                        const uint8_t *pages, size_t page_cnt);
+
+void
+test_palloc_buddy (void)
+{
+  struct bitmap *map;
+  void **held;
+  bool *keep;
+  size_t held_cnt, i;
+  unsigned l;
+
+  held = palloc_get_multiple (PAL_ASSERT, HELD_PAGES);
+  keep = palloc_get_multiple (PAL_ASSERT,
+                              DIV_ROUND_UP (HELD_MAX * sizeof *keep, PGSIZE));
+  map = bitmap_create (HELD_MAX);
+  ASSERT (map != NULL);
+  random_init (0);
+
+  for (l = 0; l < sizeof frag_levels / sizeof *frag_levels; l++)
+    {
+      uint64_t start, buddy_cycles, bitmap_cycles;
+      int buddy_fails = 0, bitmap_fails = 0;
+
+      /* Take every free page, then give back the ones we don't
+         keep. */
+      for (held_cnt = 0; held_cnt < HELD_MAX; held_cnt++)
+        {
+          held[held_cnt] = palloc_get_page (0);
+          if (held[held_cnt] == NULL)
+            break;
+        }
+      bitmap_set_all (map, true);
+      for (i = 0; i < held_cnt; i++)
+        {
+          keep[i] = random_ulong () % 100 < (unsigned) frag_levels[l];
+          bitmap_set (map, i, keep[i]);
+          if (!keep[i])
+            palloc_free_page (held[i]);
+        }
+
+      start = rdtsc ();
+      for (i = 0; i < ITER_CNT; i++)
+        {
+          size_t page_cnt = request_sizes[i % (sizeof request_sizes
+                                               / sizeof *request_sizes)];
+          void *pages = palloc_get_multiple (0, page_cnt);
+          if (pages != NULL)
+            palloc_free_multiple (pages, page_cnt);
+          else
+            buddy_fails++;
+        }
+      buddy_cycles = rdtsc () - start;
+
+      start = rdtsc ();
+      for (i = 0; i < ITER_CNT; i++)
+        {
+          size_t page_cnt = request_sizes[i % (sizeof request_sizes
+                                               / sizeof *request_sizes)];
+          enum intr_level old_level = intr_disable ();
+          size_t idx = bitmap_scan_and_flip (map, 0, page_cnt, false);
+          if (idx != BITMAP_ERROR)
+            bitmap_set_multiple (map, idx, page_cnt, false);
+          else
+            bitmap_fails++;
+          intr_set_level (old_level);
+        }
+      bitmap_cycles = rdtsc () - start;
+
+      /* Check that allocations avoid the pages still held. */
+      for (i = 0; i < sizeof request_sizes / sizeof *request_sizes; i++)
+        {
+          size_t page_cnt = request_sizes[i];
+          uint8_t *pages = palloc_get_multiple (0, page_cnt);
+          if (pages != NULL)
+            {
+              if (still_held (held, held_cnt, keep, pages, page_cnt))
+                fail ("%zu-page block at %p overlaps a held page",
+                      page_cnt, pages);
+              palloc_free_multiple (pages, page_cnt);
+            }
+        }
+
+      msg ("%d%% of %zu pages held: buddy %"PRIu64" cycles "
+           "(%d failed), bitmap %"PRIu64" cycles (%d failed).",
+           frag_levels[l], held_cnt, buddy_cycles / ITER_CNT, buddy_fails,
+           bitmap_cycles / ITER_CNT, bitmap_fails);
+      if (frag_levels[l] == 0 && buddy_fails != 0)
+        fail ("%d allocations failed with all pages free", buddy_fails);
+
+      for (i = 0; i < held_cnt; i++)
+        if (keep[i])
+          palloc_free_page (held[i]);
+    }
+
+  bitmap_destroy (map);
+  palloc_free_multiple (keep, DIV_ROUND_UP (HELD_MAX * sizeof *keep, PGSIZE));
+  palloc_free_multiple (held, HELD_PAGES);
+  pass ();
+}
+
+/* Returns true if any page in HELD that KEEP says is still held
+   lies within the PAGE_CNT pages at PAGES. */
+static bool
+still_held (void **held, size_t held_cnt, const bool *keep,
+            const uint8_t *pages, size_t page_cnt)
+{
+  size_t i;
+
+  for (i = 0; i < held_cnt; i++)
+    if (keep[i]
+        && (uint8_t *) held[i] >= pages
+        && (uint8_t *) held[i] < pages + page_cnt * PGSIZE)
+      return true;
+  return false;
+}
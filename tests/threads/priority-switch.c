@@ -0,0 +1,170 @@
+/* Measures the cost of a context switch with 64 threads ready at
+   once, and compares the cost of choosing the next thread from
+   the per-priority ready queues with the cost of doing the same
+   with a single FIFO ready list.
+
+   The threads are spread over priorities PRI_MIN through
+   PRI_DEFAULT, two at each, so that the scheduler has many
+   non-empty ready queues to choose the highest from.  Each thread
+   yields ITER_CNT times, and each yield passes the CPU to the other
+   thread at the same priority.  For comparison, the test then
+   times the same number of selections on a single list of 64
+   elements, both as a plain FIFO (which ignores priorities) and
+   as a list scanned for the highest priority (the minimum needed
+   to honor priorities with one list).
+
+   The test fails if any thread has not yielded ITER_CNT times by
+   the time all of them have signaled that they are done. */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <list.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/tsc.h"
+
+#define THREAD_CNT 64
+#define ITER_CNT 100
+
+/* Priority of thread I. */
+#define THREAD_PRIORITY(I) (PRI_MIN + (I) % (PRI_DEFAULT - PRI_MIN + 1))
+
+struct yield_data
+  {
+    int iterations;             /* Yields so far. */
+    struct semaphore *done;     /* Upped when all yields are done. */
+  };
+
+static thread_func yield_thread_func;
+
+/* Stand-in for a ready thread on a single ready list. */
+struct list_thread
+  {
+    struct list_elem elem;
+    int priority;
+  };
+
+static uint64_t time_fifo_list (struct list_thread *, bool scan);
+static bool priority_less (const struct list_elem *,
+                           const struct list_elem *, void *);
+
+void
+test_priority_switch (void)
+{
+  static struct list_thread stand_ins[THREAD_CNT];
+  struct yield_data data[THREAD_CNT];
+  struct semaphore done;
+  uint64_t start, switch_cycles, fifo_cycles, scan_cycles;
+  int switch_cnt = THREAD_CNT * ITER_CNT;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  msg ("%d threads will each yield %d times.", THREAD_CNT, ITER_CNT);
+
+  /* Run above the yielding threads while creating them, so that
+     none of them runs before we start timing. */
+  sema_init (&done, 0);
+  thread_set_priority (PRI_DEFAULT + 1);
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "yield %d", i);
+      data[i].iterations = 0;
+      data[i].done = &done;
+      thread_create (name, THREAD_PRIORITY (i), yield_thread_func, &data[i]);
+    }
+
+  start = rdtsc ();
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_down (&done);
+  switch_cycles = rdtsc () - start;
+  thread_set_priority (PRI_DEFAULT);
+
+  for (i = 0; i < THREAD_CNT; i++)
+    if (data[i].iterations != ITER_CNT)
+      fail ("thread %d yielded %d times, expected %d",
+            i, data[i].iterations, ITER_CNT);
+
+  for (i = 0; i < THREAD_CNT; i++)
+    stand_ins[i].priority = THREAD_PRIORITY (i);
+  fifo_cycles = time_fifo_list (stand_ins, false);
+  scan_cycles = time_fifo_list (stand_ins, true);
+
+  msg ("Context switch: %"PRIu64" cycles.", switch_cycles / switch_cnt);
+  msg ("FIFO list selection: %"PRIu64" cycles.", fifo_cycles / switch_cnt);
+  msg ("Priority-scanned list selection: %"PRIu64" cycles.",
+       scan_cycles / switch_cnt);
+  pass ();
+}
+
+static void
+yield_thread_func (void *data_)
+{
+  struct yield_data *data = data_;
+  int i;
+
+  for (i = 0; i < ITER_CNT; i++)
+    {
+      thread_yield ();
+      data->iterations++;
+    }
+  sema_up (data->done);
+}
+
+/* Times THREAD_CNT * ITER_CNT selections of a "next thread" from
+   a single list holding the THREAD_CNT elements of STAND_INS,
+   putting each selected element back at the end of the list as
+   thread_yield() would.  If SCAN is true, the highest-priority
+   element is selected, otherwise the front one.  Returns the
+   number of cycles taken. */
+static uint64_t
+time_fifo_list (struct list_thread *stand_ins, bool scan)
+{
+  struct list list;
+  enum intr_level old_level;
+  uint64_t start, cycles;
+  int i;
+
+  list_init (&list);
+  for (i = 0; i < THREAD_CNT; i++)
+    list_push_back (&list, &stand_ins[i].elem);
+
+  old_level = intr_disable ();
+  start = rdtsc ();
+  for (i = 0; i < THREAD_CNT * ITER_CNT; i++)
+    {
+      struct list_elem *e;
+
+      if (scan)
+        {
+          e = list_max (&list, priority_less, NULL);
+          list_remove (e);
+        }
+      else
+        e = list_pop_front (&list);
+      list_push_back (&list, e);
+    }
+  cycles = rdtsc () - start;
+  intr_set_level (old_level);
+
+  return cycles;
+}
+
+/* Orders list_threads by ascending priority. */
+static bool
+priority_less (const struct list_elem *a_, const struct list_elem *b_,
+               void *aux UNUSED)
+{
+  const struct list_thread *a = list_entry (a_, struct list_thread, elem);
+  const struct list_thread *b = list_entry (b_, struct list_thread, elem);
+
+  return a->priority < b->priority;
+}
@@ -0,0 +1,157 @@
+/* Compares the throughput of 16 readers and 1 writer sharing a
+   reader-writer lock with the same threads sharing a plain lock.
+
+   Each reader repeatedly holds the lock for one timer tick,
+   sleeping as if waiting for I/O, and each writer acquisition
+   does the same.  With a plain lock, only one reader can hold
+   the lock at a time, so reads complete at most once per tick.
+   With a reader-writer lock, all the readers can hold it at
+   once, so reads should complete many times faster, even with
+   the writer getting in every few ticks.
+
+   The test also checks that a writer never holds the lock
+   together with a reader or another writer. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define READER_CNT 16
+#define TEST_TICKS (2 * TIMER_FREQ)
+#define WRITE_PERIOD 10
+
+struct rw_data
+  {
+    bool use_rwlock;            /* Use RWLOCK or LOCK? */
+    struct rwlock rwlock;
+    struct lock lock;
+    int64_t end_time;           /* When to stop. */
+    int readers_in;             /* Readers holding the lock. */
+    int writers_in;             /* Writers holding the lock. */
+    int read_cnt;               /* Reads completed. */
+    int write_cnt;              /* Writes completed. */
+    struct semaphore done;      /* Upped when each thread finishes. */
+  };
+
+static thread_func reader_thread, writer_thread;
+static void run (struct rw_data *, bool use_rwlock);
+
+void
+test_rwlock_readers (void)
+{
+  struct rw_data *data;
+  int lock_reads, rwlock_reads;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  data = malloc (sizeof *data);
+  ASSERT (data != NULL);
+
+  msg ("%d readers and 1 writer run for %d ticks with each lock type.",
+       READER_CNT, TEST_TICKS);
+
+  run (data, false);
+  lock_reads = data->read_cnt;
+  msg ("Plain lock: %d reads, %d writes.", data->read_cnt, data->write_cnt);
+
+  run (data, true);
+  rwlock_reads = data->read_cnt;
+  msg ("Reader-writer lock: %d reads, %d writes.",
+       data->read_cnt, data->write_cnt);
+
+  free (data);
+
+  if (rwlock_reads < lock_reads * 4)
+    fail ("reader-writer lock allowed only %d reads, vs. %d with a lock",
+          rwlock_reads, lock_reads);
+  pass ();
+}
+
+/* Runs READER_CNT readers and one writer on DATA for TEST_TICKS
+   ticks, using a reader-writer lock if USE_RWLOCK is true and a
+   plain lock otherwise. */
+static void
+run (struct rw_data *data, bool use_rwlock)
+{
+  int i;
+
+  data->use_rwlock = use_rwlock;
+  rwlock_init (&data->rwlock);
+  lock_init (&data->lock);
+  data->end_time = timer_ticks () + TEST_TICKS;
+  data->readers_in = data->writers_in = 0;
+  data->read_cnt = data->write_cnt = 0;
+  sema_init (&data->done, 0);
+
+  for (i = 0; i < READER_CNT; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "reader %d", i);
+      thread_create (name, PRI_DEFAULT, reader_thread, data);
+    }
+  thread_create ("writer", PRI_DEFAULT, writer_thread, data);
+
+  for (i = 0; i < READER_CNT + 1; i++)
+    sema_down (&data->done);
+}
+
+static void
+reader_thread (void *data_)
+{
+  struct rw_data *data = data_;
+
+  while (timer_ticks () < data->end_time)
+    {
+      if (data->use_rwlock)
+        rwlock_read_acquire (&data->rwlock);
+      else
+        lock_acquire (&data->lock);
+
+      data->readers_in++;
+      if (data->writers_in != 0)
+        fail ("reader entered while a writer held the lock");
+      timer_sleep (1);
+      data->readers_in--;
+      data->read_cnt++;
+
+      if (data->use_rwlock)
+        rwlock_read_release (&data->rwlock);
+      else
+        lock_release (&data->lock);
+    }
+  sema_up (&data->done);
+}
+
+static void
+writer_thread (void *data_)
+{
+  struct rw_data *data = data_;
+
+  while (timer_ticks () < data->end_time)
+    {
+      timer_sleep (WRITE_PERIOD);
+
+      if (data->use_rwlock)
+        rwlock_write_acquire (&data->rwlock);
+      else
+        lock_acquire (&data->lock);
+
+      data->writers_in++;
+      if (data->readers_in != 0 || data->writers_in != 1)
+        fail ("writer entered while another thread held the lock");
+      timer_sleep (1);
+      data->writers_in--;
+      data->write_cnt++;
+
+      if (data->use_rwlock)
+        rwlock_write_release (&data->rwlock);
+      else
+        lock_release (&data->lock);
+    }
+  sema_up (&data->done);
+}
@@ -0,0 +1,97 @@
+/* Checks that the stride scheduler divides the CPU among
+   threads in proportion to their tickets.
+
+   Three threads with 100, 200, and 300 tickets spin for 10
+   seconds.  Each should then have run for 1/6, 2/6, and 3/6 of
+   the ticks that the three ran in total, and the test fails if
+   any share is off by more than 5% of its expected value. */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define THREAD_CNT 3
+#define TEST_SECONDS 10
+
+struct spin_info
+  {
+    int tickets;                /* Tickets to run with. */
+    int64_t start_time;         /* When to start spinning. */
+    int64_t run_ticks;          /* Ticks run while spinning. */
+    struct semaphore *done;     /* Upped when done spinning. */
+  };
+
+static thread_func spin_thread;
+
+void
+test_stride_fair (void)
+{
+  struct spin_info info[THREAD_CNT];
+  struct semaphore done;
+  int64_t start_time, total_ticks;
+  int total_tickets;
+  int i;
+
+  ASSERT (thread_stride);
+
+  msg ("%d threads will spin for %d seconds.", THREAD_CNT, TEST_SECONDS);
+
+  sema_init (&done, 0);
+  start_time = timer_ticks () + TIMER_FREQ / 10;
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "spin %d", i);
+      info[i].tickets = (i + 1) * TICKETS_DEFAULT;
+      info[i].start_time = start_time;
+      info[i].run_ticks = 0;
+      info[i].done = &done;
+      thread_create (name, PRI_DEFAULT, spin_thread, &info[i]);
+    }
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_down (&done);
+
+  total_ticks = total_tickets = 0;
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      total_ticks += info[i].run_ticks;
+      total_tickets += info[i].tickets;
+    }
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      int64_t expected = total_ticks * info[i].tickets / total_tickets;
+      int64_t error = info[i].run_ticks - expected;
+
+      msg ("Thread with %d tickets ran %"PRId64" ticks, expected %"PRId64".",
+           info[i].tickets, info[i].run_ticks, expected);
+      if (error < 0)
+        error = -error;
+      if (error * 100 > expected * 5)
+        fail ("share of thread with %d tickets is off by more than 5%%",
+              info[i].tickets);
+    }
+  pass ();
+}
+
+static void
+spin_thread (void *info_)
+{
+  struct spin_info *info = info_;
+  struct usage before, after;
+  int64_t end_time = info->start_time + TEST_SECONDS * TIMER_FREQ;
+
+  thread_set_tickets (info->tickets);
+  timer_sleep (info->start_time - timer_ticks ());
+
+  thread_get_usage (&before);
+  while (timer_ticks () < end_time)
+    continue;
+  thread_get_usage (&after);
+
+  info->run_ticks = after.run_ticks - before.run_ticks;
+  sema_up (info->done);
+}
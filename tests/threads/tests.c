@@ -17,6 +17,7 @@ static const struct test tests[] =
     {"alarm-priority", test_alarm_priority},
     {"alarm-zero", test_alarm_zero},
     {"alarm-negative", test_alarm_negative},
+    {"alarm-wheel", test_alarm_wheel},
     {"priority-change", test_priority_change},
     {"priority-donate-one", test_priority_donate_one},
     {"priority-donate-multiple", test_priority_donate_multiple},
@@ -29,6 +30,14 @@ static const struct test tests[] =
     {"priority-preempt", test_priority_preempt},
     {"priority-sema", test_priority_sema},
     {"priority-condvar", test_priority_condvar},
+    {"priority-switch", test_priority_switch},
+    {"thread-spawn", test_thread_spawn},
+    {"stride-fair", test_stride_fair},
+    {"rwlock-readers", test_rwlock_readers},
+    {"palloc-buddy", test_palloc_buddy},
+    {"slab-alloc", test_slab_alloc},
+    {"malloc-stress", test_malloc_stress},
+    {"malloc-realloc", test_malloc_realloc},
     {"mlfqs-load-1", test_mlfqs_load_1},
     {"mlfqs-load-60", test_mlfqs_load_60},
     {"mlfqs-load-avg", test_mlfqs_load_avg},
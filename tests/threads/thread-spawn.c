@@ -0,0 +1,64 @@
+/* Measures how fast threads can be created and destroyed.
+
+   The main thread repeatedly creates a thread of higher priority
+   that exits immediately, so that each new thread runs and dies
+   before the next one is created.  This is the pattern that
+   benefits from recycling dead threads' pages.
+
+   The rate is informational; the test passes as long as every
+   thread runs. */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/thread.h"
+#include "threads/tsc.h"
+#include "devices/timer.h"
+
+#define SPAWN_CNT 5000
+
+static thread_func spawn_thread_func;
+
+void
+test_thread_spawn (void)
+{
+  int run_cnt = 0;
+  int64_t start_ticks, elapsed;
+  uint64_t start_tsc, cycles;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  msg ("Spawning %d threads.", SPAWN_CNT);
+
+  start_ticks = timer_ticks ();
+  start_tsc = rdtsc ();
+  for (i = 0; i < SPAWN_CNT; i++)
+    if (thread_create ("spawn", PRI_DEFAULT + 1, spawn_thread_func,
+                       &run_cnt) == TID_ERROR)
+      fail ("thread_create failed after %d threads", i);
+  cycles = rdtsc () - start_tsc;
+  elapsed = timer_elapsed (start_ticks);
+
+  if (run_cnt != SPAWN_CNT)
+    fail ("%d threads ran, expected %d", run_cnt, SPAWN_CNT);
+
+  msg ("Spawn and exit: %"PRIu64" cycles per thread.", cycles / SPAWN_CNT);
+  if (elapsed > 0)
+    msg ("Spawn and exit: %"PRId64" threads per second.",
+         SPAWN_CNT * TIMER_FREQ / elapsed);
+  else
+    msg ("Spawn and exit: more than %d threads per second.",
+         SPAWN_CNT * TIMER_FREQ);
+  pass ();
+}
+
+static void
+spawn_thread_func (void *run_cnt_)
+{
+  int *run_cnt = run_cnt_;
+
+  (*run_cnt)++;
+}
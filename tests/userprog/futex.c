@@ -0,0 +1,28 @@
+/* Exercises the futex system calls and the user-space mutex
+   built on them, without contention. */
+
+#include <mutex.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct mutex mutex;
+  int futex = 5;
+
+  CHECK (futex_wait (&futex, 6) == -1,
+         "futex_wait with unexpected value returns at once");
+  CHECK (futex_wake (&futex, 1) == 0, "futex_wake with no waiters");
+
+  mutex_init (&mutex);
+  CHECK (mutex_trylock (&mutex), "mutex_trylock on unlocked mutex");
+  CHECK (!mutex_trylock (&mutex), "mutex_trylock on locked mutex");
+  mutex_unlock (&mutex);
+  mutex_lock (&mutex);
+  CHECK (!mutex_trylock (&mutex), "mutex_lock locked the mutex");
+  mutex_unlock (&mutex);
+  CHECK (mutex_trylock (&mutex), "mutex_unlock unlocked the mutex");
+  mutex_unlock (&mutex);
+}
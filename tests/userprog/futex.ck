@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(futex) begin
+(futex) futex_wait with unexpected value returns at once
+(futex) futex_wake with no waiters
+(futex) mutex_trylock on unlocked mutex
+(futex) mutex_trylock on locked mutex
+(futex) mutex_lock locked the mutex
+(futex) mutex_unlock unlocked the mutex
+(futex) end
+futex: exit(0)
+EOF
+pass;
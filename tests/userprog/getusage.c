@@ -0,0 +1,24 @@
+/* Reads this process's CPU usage before and after spinning for a
+   while, and checks that the reported run time grew. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct usage before, after;
+  volatile int i;
+
+  CHECK (getusage (&before), "getusage");
+  for (i = 0; i < 1000000; i++)
+    continue;
+  CHECK (getusage (&after), "getusage again");
+
+  if (after.run_cycles <= before.run_cycles)
+    fail ("run time did not increase");
+  if (after.run_ticks < before.run_ticks)
+    fail ("run ticks decreased");
+  msg ("run time increased");
+}
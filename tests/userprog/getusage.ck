@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(getusage) begin
+(getusage) getusage
+(getusage) getusage again
+(getusage) run time increased
+(getusage) end
+getusage: exit(0)
+EOF
+pass;
@@ -0,0 +1,45 @@
+/* Reads the kernel memory statistics and checks that they are
+   consistent. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static void
+check_pool (const char *name, const struct memstat_pool *p)
+{
+  if (p->used_pages + p->free_pages != p->total_pages)
+    fail ("%s pool: %u used + %u free != %u total", name,
+          (unsigned) p->used_pages, (unsigned) p->free_pages,
+          (unsigned) p->total_pages);
+  if (p->peak_pages < p->used_pages)
+    fail ("%s pool: peak below current use", name);
+  if (p->zeroed_pages > p->free_pages)
+    fail ("%s pool: more zeroed pages than free pages", name);
+}
+
+void
+test_main (void) 
+{
+  struct memstat stats;
+  unsigned i;
+
+  CHECK (memstat (&stats), "memstat");
+  check_pool ("kernel", &stats.kernel);
+  check_pool ("user", &stats.user);
+  if (stats.user.used_pages == 0)
+    fail ("user pool has no pages in use");
+
+  if (stats.class_cnt == 0 || stats.class_cnt > MEMSTAT_CLASS_MAX)
+    fail ("bad class count %u", (unsigned) stats.class_cnt);
+  for (i = 0; i < stats.class_cnt; i++)
+    {
+      const struct memstat_class *c = &stats.classes[i];
+      if (i > 0 && c->block_size <= stats.classes[i - 1].block_size)
+        fail ("block sizes out of order");
+      if (c->requested_bytes > c->allocated_bytes)
+        fail ("%u-byte blocks: more bytes requested than allocated",
+              (unsigned) c->block_size);
+    }
+  msg ("statistics are consistent");
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(memstat) begin
+(memstat) memstat
+(memstat) statistics are consistent
+(memstat) end
+memstat: exit(0)
+EOF
+pass;
@@ -0,0 +1,42 @@
+/* Opens "sample.txt" OPEN_CNT times, many more than would fit
+   in a fixed-size descriptor table, checking that every
+   descriptor is new.  Then closes one descriptor in the middle
+   and checks that the next open() reuses it, since open()
+   returns the lowest free descriptor, and closes everything. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define OPEN_CNT 1000
+
+/* Lowest descriptor open() may return, since the ones below it
+   belong to the console. */
+#define FD_MIN 3
+
+void
+test_main (void) 
+{
+  static int fds[OPEN_CNT];
+  int i, fd;
+
+  for (i = 0; i < OPEN_CNT; i++)
+    {
+      fds[i] = open ("sample.txt");
+      if (fds[i] < FD_MIN)
+        fail ("open #%d returned %d", i, fds[i]);
+      if (i > 0 && fds[i] <= fds[i - 1])
+        fail ("open #%d returned %d after %d", i, fds[i], fds[i - 1]);
+    }
+  msg ("opened \"sample.txt\" %d times", OPEN_CNT);
+
+  close (fds[OPEN_CNT / 2]);
+  CHECK ((fd = open ("sample.txt")) == fds[OPEN_CNT / 2],
+         "reopen reuses closed descriptor");
+  CHECK (filesize (fds[OPEN_CNT - 1]) == filesize (fd),
+         "last descriptor refers to \"sample.txt\"");
+
+  for (i = 0; i < OPEN_CNT; i++)
+    close (fds[i]);
+  msg ("closed all descriptors");
+}
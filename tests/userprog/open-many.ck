@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(open-many) begin
+(open-many) opened "sample.txt" 1000 times
+(open-many) reopen reuses closed descriptor
+(open-many) last descriptor refers to "sample.txt"
+(open-many) closed all descriptors
+(open-many) end
+open-many: exit(0)
+EOF
+pass;
@@ -19,7 +19,10 @@
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
@@ -53,6 +56,9 @@ static bool format_filesys;
 /* -q: Power off after kernel tasks complete? */
 bool power_off_when_done;
 
+/* -trace: Record scheduler events? */
+static bool trace_option;
+
 static void ram_init (void);
 static void paging_init (void);
 
@@ -60,6 +66,9 @@ static char **read_command_line (void);
 static char **parse_options (char **argv);
 static void run_actions (char **argv);
 static void usage (void);
+#ifdef FILESYS
+static void get_file (char **argv);
+#endif
 
 static void print_stats (void);
 
@@ -83,7 +92,6 @@ main (void)
      then enable console locking. */
   thread_init ();
   console_init ();
-  frame_init();
   /* Greet user. */
   printf ("Pintos booting with %'zu kB RAM...\n", ram_pages * PGSIZE / 1024);
 
@@ -91,6 +99,12 @@ main (void)
   palloc_init ();
   malloc_init ();
   paging_init ();
+#ifdef VM
+  frame_init ();
+  page_slab_init ();
+#endif
+  if (trace_option)
+    trace_init ();
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -110,6 +124,7 @@ main (void)
 
   /* Start thread scheduler and enable interrupts. */
   thread_start ();
+  palloc_start_zeroer ();
   serial_init_queue ();
   timer_calibrate ();
 
@@ -117,6 +132,9 @@ main (void)
   /* Initialize file system. */
   disk_init ();
   swap_init ();
+#ifdef VM
+  frame_start_pageout ();
+#endif
   filesys_init (format_filesys);
 #endif
 
@@ -249,13 +267,25 @@ parse_options (char **argv)
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-stride"))
+        thread_stride = true;
+      else if (!strcmp (name, "-trace"))
+        trace_option = true;
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-wl"))
+        pageout_low_water = atoi (value);
+      else if (!strcmp (name, "-wh"))
+        pageout_high_water = atoi (value);
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
     }
+  if (thread_mlfqs && thread_stride)
+    PANIC ("-mlfqs and -stride cannot be used together");
 
   return argv;
 }
@@ -297,7 +327,9 @@ run_actions (char **argv)
       {"cat", 2, fsutil_cat},
       {"rm", 2, fsutil_rm},
       {"put", 2, fsutil_put},
-      {"get", 2, fsutil_get},
+      {"get", 2, get_file},
+#else
+      {"get", 2, trace_get},
 #endif
       {NULL, 0, NULL},
     };
@@ -326,6 +358,19 @@ run_actions (char **argv)
 
 }
 
+#ifdef FILESYS
+/* The "get" action.  Copies file ARGV[1] from the file system to
+   the scratch disk.  If tracing is enabled and ARGV[1] is
+   TRACE_FILE_NAME, first saves the trace to that file. */
+static void
+get_file (char **argv)
+{
+  if (trace_enabled && !strcmp (argv[1], TRACE_FILE_NAME))
+    trace_save (argv[1]);
+  fsutil_get (argv);
+}
+#endif
+
 /* Prints a kernel command line help message and powers off the
    machine. */
 static void
@@ -347,6 +392,10 @@ usage (void)
           "Use these actions indirectly via `pintos' -g and -p options:\n"
           "  put FILE           Put FILE into file system from scratch disk.\n"
           "  get FILE           Get FILE from file system into scratch disk.\n"
+          "  get trace          Get scheduler trace into scratch disk.\n"
+#else
+          "Use this action indirectly via `pintos' -g option:\n"
+          "  get trace          Get scheduler trace into scratch disk.\n"
 #endif
           "\nOptions:\n"
           "  -h                 Print this help message and power off.\n"
@@ -354,8 +403,14 @@ usage (void)
           "  -f                 Format file system disk during startup.\n"
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -stride            Use stride (proportional-share) scheduler.\n"
+          "  -trace             Record scheduler events for `get trace'.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -wl=COUNT          Start paging out below COUNT free frames.\n"
+          "  -wh=COUNT          Page out until COUNT frames are free.\n"
 #endif
           );
   power_off ();
@@ -392,6 +447,14 @@ print_stats (void)
 {
   timer_print_stats ();
   thread_print_stats ();
+  palloc_print_stats ();
+  malloc_print_stats ();
+  kmem_print_stats ();
+  lock_print_stats ();
+#ifdef VM
+  frame_print_stats ();
+  swap_print_stats ();
+#endif
 #ifdef FILESYS
   disk_print_stats ();
 #endif
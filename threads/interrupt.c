@@ -35,6 +35,15 @@ static const char *intr_names[INTR_CNT];
 static bool in_external_intr;   /* Are we processing an external interrupt? */
 static bool yield_on_return;    /* Should we yield on interrupt return? */
 
+/* Bottom halves requested with intr_defer() by the external
+   interrupt handler now running.  They run once the interrupt
+   has been acknowledged on the PIC, still in interrupt context
+   with interrupts off (external interrupts never nest), so like
+   handlers they may not sleep. */
+#define BH_CNT 8
+static intr_bh_func *pending_bhs[BH_CNT];
+static size_t pending_bh_cnt;
+
 /* Programmable Interrupt Controller helpers. */
 static void pic_init (void);
 static void pic_end_of_interrupt (int irq);
@@ -46,6 +55,7 @@ static inline uint64_t make_idtr_operand (uint16_t limit, void *base);
 
 /* Interrupt handlers. */
 void intr_handler (struct intr_frame *args);
+static void run_bottom_halves (void);
 
 /* Returns the current interrupt status. */
 enum intr_level
@@ -211,6 +221,25 @@ intr_yield_on_return (void)
   ASSERT (intr_context ());
   yield_on_return = true;
 }
+
+/* During processing of an external interrupt, arranges for BH to
+   be called once the interrupt has been acknowledged, before the
+   interrupt returns.  Requesting the same BH more than once per
+   interrupt calls it only once.  May not be called at any other
+   time. */
+void
+intr_defer (intr_bh_func *bh) 
+{
+  size_t i;
+
+  ASSERT (intr_context ());
+
+  for (i = 0; i < pending_bh_cnt; i++)
+    if (pending_bhs[i] == bh)
+      return;
+  ASSERT (pending_bh_cnt < BH_CNT);
+  pending_bhs[pending_bh_cnt++] = bh;
+}
 
 /* 8259A Programmable Interrupt Controller. */
 
@@ -379,14 +408,28 @@ intr_handler (struct intr_frame *frame)
       ASSERT (intr_get_level () == INTR_OFF);
       ASSERT (intr_context ());
 
-      in_external_intr = false;
       pic_end_of_interrupt (frame->vec_no); 
+      run_bottom_halves ();
+      in_external_intr = false;
 
       if (yield_on_return) 
         thread_yield (); 
     }
 }
 
+/* Runs the bottom halves requested by the current external
+   interrupt handler, including any requested by a bottom half
+   while they run. */
+static void
+run_bottom_halves (void) 
+{
+  size_t i;
+
+  for (i = 0; i < pending_bh_cnt; i++)
+    pending_bhs[i] ();
+  pending_bh_cnt = 0;
+}
+
 /* Dumps interrupt frame F to the console, for debugging. */
 void
 intr_dump_frame (const struct intr_frame *f) 
@@ -56,6 +56,7 @@ struct intr_frame
   };
 
 typedef void intr_handler_func (struct intr_frame *);
+typedef void intr_bh_func (void);
 
 void intr_init (void);
 void intr_register_ext (uint8_t vec, intr_handler_func *, const char *name);
@@ -63,6 +64,7 @@ void intr_register_int (uint8_t vec, int dpl, enum intr_level,
                         intr_handler_func *, const char *name);
 bool intr_context (void);
 void intr_yield_on_return (void);
+void intr_defer (intr_bh_func *);
 
 void intr_dump_frame (const struct intr_frame *);
 const char *intr_name (uint8_t vec);
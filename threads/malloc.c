@@ -1,12 +1,15 @@
 #include "threads/malloc.h"
 #include <debug.h>
+#include <inttypes.h>
 #include <list.h>
 #include <round.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* A simple implementation of malloc().
@@ -32,7 +35,19 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   To keep the descriptor locks off the common path, each thread
+   has a small "magazine" of free blocks for each descriptor.
+   malloc() takes a block from the running thread's magazine and
+   free() puts one back, neither taking a lock.  Only when a
+   magazine is empty (or full) does the thread lock the
+   descriptor, to move MAG_BATCH blocks from (or to) the
+   descriptor's free list at once.  Blocks in magazines count as
+   in use by their arenas.  A thread's magazines are emptied
+   when it exits.  Magazines also count the bytes requested
+   through them, adding the counts to their descriptor's
+   statistics whenever they lock it. */
 
 /* Descriptor. */
 struct desc
@@ -41,6 +56,13 @@ struct desc
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
     struct list free_list;      /* List of free blocks. */
     struct lock lock;           /* Lock. */
+    char lock_name[16];         /* Name of LOCK, e.g. "malloc 16". */
+
+    /* Statistics, protected by LOCK. */
+    size_t arena_cnt;           /* Number of arenas. */
+    size_t free_cnt;            /* Number of blocks in FREE_LIST. */
+    uint64_t alloc_cnt;         /* Blocks ever handed out. */
+    uint64_t requested_bytes;   /* Bytes ever requested. */
   };
 
 /* Magic number for detecting arena corruption. */
@@ -60,12 +82,30 @@ struct block
     struct list_elem free_elem; /* Free list element. */
   };
 
+/* Number of blocks in a full magazine, and the number moved to
+   or from a descriptor at once. */
+#define MAG_SIZE 8
+#define MAG_BATCH (MAG_SIZE / 2)
+
+/* Per-thread cache of free blocks for one descriptor. */
+struct magazine
+  {
+    size_t cnt;                 /* Number of blocks in BLOCKS. */
+    struct block *blocks[MAG_SIZE]; /* Free blocks, used as a stack. */
+    unsigned alloc_cnt;         /* Blocks handed out since last flush. */
+    uint64_t requested_bytes;   /* Bytes requested since last flush. */
+  };
+
 /* Our set of descriptors. */
 static struct desc descs[10];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static struct block *desc_get (struct desc *);
+static void desc_put (struct desc *, struct block *);
+static struct magazine *thread_magazines (void);
+static void magazine_flush (struct desc *, struct magazine *);
 
 /* Initializes the malloc() descriptors. */
 void
@@ -80,7 +120,10 @@ malloc_init (void)
       d->block_size = block_size;
       d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
       list_init (&d->free_list);
-      lock_init (&d->lock);
+      snprintf (d->lock_name, sizeof d->lock_name, "malloc %zu", block_size);
+      lock_init_named (&d->lock, d->lock_name);
+      d->arena_cnt = d->free_cnt = 0;
+      d->alloc_cnt = d->requested_bytes = 0;
     }
 }
 
@@ -92,6 +135,7 @@ malloc (size_t size)
   struct desc *d;
   struct block *b;
   struct arena *a;
+  struct magazine *m;
 
   /* A null pointer satisfies a request for 0 bytes. */
   if (size == 0)
@@ -119,36 +163,35 @@ malloc (size_t size)
       return a + 1;
     }
 
-  lock_acquire (&d->lock);
-
-  /* If the free list is empty, create a new arena. */
-  if (list_empty (&d->free_list))
+  /* Take a block from our magazine, refilling it from the
+     descriptor if it is empty. */
+  m = thread_magazines ();
+  if (m != NULL)
     {
-      size_t i;
-
-      /* Allocate a page. */
-      a = palloc_get_page (0);
-      if (a == NULL) 
+      m += d - descs;
+      if (m->cnt == 0)
         {
+          lock_acquire (&d->lock);
+          magazine_flush (d, m);
+          while (m->cnt < MAG_BATCH && (b = desc_get (d)) != NULL)
+            m->blocks[m->cnt++] = b;
           lock_release (&d->lock);
-          return NULL; 
-        }
-
-      /* Initialize arena and add its blocks to the free list. */
-      a->magic = ARENA_MAGIC;
-      a->desc = d;
-      a->free_cnt = d->blocks_per_arena;
-      for (i = 0; i < d->blocks_per_arena; i++) 
-        {
-          struct block *b = arena_to_block (a, i);
-          list_push_back (&d->free_list, &b->free_elem);
+          if (m->cnt == 0)
+            return NULL;
         }
+      m->alloc_cnt++;
+      m->requested_bytes += size;
+      return m->blocks[--m->cnt];
     }
 
-  /* Get a block from free list and return it. */
-  b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
-  a = block_to_arena (b);
-  a->free_cnt--;
+  /* No magazines: get a block straight from the descriptor. */
+  lock_acquire (&d->lock);
+  b = desc_get (d);
+  if (b != NULL)
+    {
+      d->alloc_cnt++;
+      d->requested_bytes += size;
+    }
   lock_release (&d->lock);
   return b;
 }
@@ -190,7 +233,12 @@ block_size (void *block)
    If successful, returns the new block; on failure, returns a
    null pointer.
    A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
-   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK). */
+   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK).
+
+   The block stays where it is if NEW_SIZE still fits in it.  A
+   big block also stays put if it can grow into the pages that
+   follow it, and gives back the pages it no longer needs when it
+   shrinks. */
 void *
 realloc (void *old_block, size_t new_size) 
 {
@@ -199,12 +247,37 @@ realloc (void *old_block, size_t new_size)
       free (old_block);
       return NULL;
     }
+  else if (old_block == NULL)
+    return malloc (new_size);
   else 
     {
-      void *new_block = malloc (new_size);
-      if (old_block != NULL && new_block != NULL)
+      struct arena *a = block_to_arena (old_block);
+      size_t old_size = block_size (old_block);
+      void *new_block;
+
+      if (a->desc == NULL)
+        {
+          /* Big block: resize its run of pages. */
+          size_t page_cnt = DIV_ROUND_UP (new_size + sizeof *a, PGSIZE);
+          if (page_cnt < a->free_cnt)
+            {
+              palloc_free_multiple ((uint8_t *) a + page_cnt * PGSIZE,
+                                    a->free_cnt - page_cnt);
+              a->free_cnt = page_cnt;
+              return old_block;
+            }
+          else if (palloc_extend (a, a->free_cnt, page_cnt))
+            {
+              a->free_cnt = page_cnt;
+              return old_block;
+            }
+        }
+      else if (new_size <= old_size)
+        return old_block;
+
+      new_block = malloc (new_size);
+      if (new_block != NULL)
         {
-          size_t old_size = block_size (old_block);
           size_t min_size = new_size < old_size ? new_size : old_size;
           memcpy (new_block, old_block, min_size);
           free (old_block);
@@ -227,31 +300,35 @@ free (void *p)
       if (d != NULL) 
         {
           /* It's a normal block.  We handle it here. */
+          struct magazine *m;
 
 #ifndef NDEBUG
           /* Clear the block to help detect use-after-free bugs. */
           memset (b, 0xcc, d->block_size);
 #endif
-  
-          lock_acquire (&d->lock);
 
-          /* Add block to free list. */
-          list_push_front (&d->free_list, &b->free_elem);
-
-          /* If the arena is now entirely unused, free it. */
-          if (++a->free_cnt >= d->blocks_per_arena) 
+          /* Put the block in our magazine, first returning some
+             blocks to the descriptor if it is full. */
+          ASSERT (!intr_context ());
+          m = thread_current ()->magazines;
+          if (m != NULL)
             {
-              size_t i;
-
-              ASSERT (a->free_cnt == d->blocks_per_arena);
-              for (i = 0; i < d->blocks_per_arena; i++) 
+              m += d - descs;
+              if (m->cnt >= MAG_SIZE)
                 {
-                  struct block *b = arena_to_block (a, i);
-                  list_remove (&b->free_elem);
+                  lock_acquire (&d->lock);
+                  magazine_flush (d, m);
+                  while (m->cnt > MAG_SIZE - MAG_BATCH)
+                    desc_put (d, m->blocks[--m->cnt]);
+                  lock_release (&d->lock);
                 }
-              palloc_free_page (a);
+              m->blocks[m->cnt++] = b;
+              return;
             }
 
+          /* No magazines: return the block to the descriptor. */
+          lock_acquire (&d->lock);
+          desc_put (d, b);
           lock_release (&d->lock);
         }
       else
@@ -263,6 +340,203 @@ free (void *p)
     }
 }
 
+/* Returns the blocks in the running thread's magazines to their
+   descriptors and frees the magazines.  Called by thread_exit(). */
+void
+malloc_thread_exit (void) 
+{
+  struct thread *t = thread_current ();
+  struct magazine *mags = t->magazines;
+  size_t i;
+
+  if (mags == NULL)
+    return;
+
+  t->magazines = NULL;
+  for (i = 0; i < desc_cnt; i++) 
+    {
+      struct desc *d = &descs[i];
+      struct magazine *m = &mags[i];
+
+      lock_acquire (&d->lock);
+      magazine_flush (d, m);
+      while (m->cnt > 0)
+        desc_put (d, m->blocks[--m->cnt]);
+      lock_release (&d->lock);
+    }
+  free (mags);
+}
+
+/* Stores statistics about each descriptor into STATS->classes
+   and their number into STATS->class_cnt.  Blocks in threads'
+   magazines count as live, and allocations through magazines
+   are counted only once their magazines have been flushed. */
+void
+malloc_get_stats (struct memstat *stats) 
+{
+  size_t i;
+
+  stats->class_cnt = desc_cnt < MEMSTAT_CLASS_MAX ? desc_cnt
+                                                  : MEMSTAT_CLASS_MAX;
+  for (i = 0; i < stats->class_cnt; i++) 
+    {
+      struct desc *d = &descs[i];
+      struct memstat_class *c = &stats->classes[i];
+
+      lock_acquire (&d->lock);
+      c->block_size = d->block_size;
+      c->arenas = d->arena_cnt;
+      c->live_blocks = d->arena_cnt * d->blocks_per_arena - d->free_cnt;
+      c->free_blocks = d->free_cnt;
+      c->requested_bytes = d->requested_bytes;
+      c->allocated_bytes = d->alloc_cnt * d->block_size;
+      lock_release (&d->lock);
+    }
+}
+
+/* Prints statistics about each descriptor that has been used. */
+void
+malloc_print_stats (void) 
+{
+  struct memstat stats;
+  size_t i;
+
+  malloc_get_stats (&stats);
+  for (i = 0; i < stats.class_cnt; i++) 
+    {
+      const struct memstat_class *c = &stats.classes[i];
+
+      if (c->allocated_bytes == 0)
+        continue;
+      printf ("Malloc: %"PRIu32"-byte blocks: %"PRIu32" arenas, "
+              "%"PRIu32" live, %"PRIu32" free, "
+              "%"PRIu64"%% internal fragmentation\n",
+              c->block_size, c->arenas, c->live_blocks, c->free_blocks,
+              (c->allocated_bytes - c->requested_bytes) * 100
+              / c->allocated_bytes);
+    }
+}
+
+/* Adds the counts in magazine M to descriptor D's statistics and
+   resets them.  D's lock must be held. */
+static void
+magazine_flush (struct desc *d, struct magazine *m) 
+{
+  ASSERT (lock_held_by_current_thread (&d->lock));
+
+  d->alloc_cnt += m->alloc_cnt;
+  d->requested_bytes += m->requested_bytes;
+  m->alloc_cnt = 0;
+  m->requested_bytes = 0;
+}
+
+/* Returns the running thread's array of DESC_CNT magazines,
+   allocating it if necessary, or a null pointer if memory is not
+   available. */
+static struct magazine *
+thread_magazines (void) 
+{
+  struct thread *t = thread_current ();
+
+  /* Magazines are not safe against interrupt handlers, but
+     malloc() could not be called from one anyway, because of the
+     descriptor locks. */
+  ASSERT (!intr_context ());
+
+  if (t->magazines == NULL)
+    {
+      /* Get the memory straight from a descriptor, since
+         malloc() would call us back. */
+      size_t size = desc_cnt * sizeof *t->magazines;
+      struct desc *d;
+      struct block *b;
+
+      for (d = descs; d->block_size < size; d++)
+        ASSERT (d + 1 < descs + desc_cnt);
+      lock_acquire (&d->lock);
+      b = desc_get (d);
+      lock_release (&d->lock);
+      if (b == NULL)
+        return NULL;
+      memset (b, 0, size);
+      t->magazines = (struct magazine *) b;
+    }
+  return t->magazines;
+}
+
+/* Removes and returns a block from descriptor D's free list,
+   creating a new arena if the list is empty.  Returns a null
+   pointer if memory is not available.  D's lock must be held. */
+static struct block *
+desc_get (struct desc *d) 
+{
+  struct block *b;
+  struct arena *a;
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
+
+  /* If the free list is empty, create a new arena. */
+  if (list_empty (&d->free_list))
+    {
+      size_t i;
+
+      /* Allocate a page. */
+      a = palloc_get_page (0);
+      if (a == NULL) 
+        return NULL; 
+
+      /* Initialize arena and add its blocks to the free list. */
+      a->magic = ARENA_MAGIC;
+      a->desc = d;
+      a->free_cnt = d->blocks_per_arena;
+      for (i = 0; i < d->blocks_per_arena; i++) 
+        {
+          struct block *b = arena_to_block (a, i);
+          list_push_back (&d->free_list, &b->free_elem);
+        }
+      d->arena_cnt++;
+      d->free_cnt += d->blocks_per_arena;
+    }
+
+  /* Get a block from free list and return it. */
+  b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
+  a = block_to_arena (b);
+  a->free_cnt--;
+  d->free_cnt--;
+  return b;
+}
+
+/* Adds block B to descriptor D's free list, freeing B's arena if
+   it is then entirely unused.  D's lock must be held. */
+static void
+desc_put (struct desc *d, struct block *b) 
+{
+  struct arena *a = block_to_arena (b);
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
+  ASSERT (a->desc == d);
+
+  /* Add block to free list. */
+  list_push_front (&d->free_list, &b->free_elem);
+  d->free_cnt++;
+
+  /* If the arena is now entirely unused, free it. */
+  if (++a->free_cnt >= d->blocks_per_arena) 
+    {
+      size_t i;
+
+      ASSERT (a->free_cnt == d->blocks_per_arena);
+      for (i = 0; i < d->blocks_per_arena; i++) 
+        {
+          struct block *b = arena_to_block (a, i);
+          list_remove (&b->free_elem);
+        }
+      palloc_free_page (a);
+      d->arena_cnt--;
+      d->free_cnt -= d->blocks_per_arena;
+    }
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b)
@@ -2,14 +2,17 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -24,14 +27,64 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool is managed as a binary buddy system.  Free memory is
+   kept as blocks of 2**ORDER pages, each aligned (relative to the
+   pool's base) on a multiple of its own size, on one free list
+   per order.  An allocation of PAGE_CNT pages takes a block of
+   the smallest order that fits, splitting a larger block if
+   necessary, and gives back the pages beyond PAGE_CNT.  Freeing
+   merges a block with its "buddy", the other half of the block
+   of the next order up, for as long as the buddy is free too.
+   Both take time proportional to the number of orders, not to
+   the number of pages in the pool.
+
+   The free lists are protected by disabling interrupts rather
+   than by a lock, because schedule_tail() frees a dying
+   thread's page while switching threads, where it cannot block.
+   Both critical sections are short.
+
+   To take memset() off the critical path of PAL_ZERO requests,
+   a low-priority "zeroer" thread keeps up to ZERO_PAGE_MAX
+   already-zeroed pages per pool, zeroing them when nothing else
+   wants to run.  Single-page PAL_ZERO requests use these first.
+   The cached pages count as allocated, so when a pool runs dry
+   its cached pages are handed out to any request. */
+
+/* Number of block orders.  The largest block is 2**(BUDDY_ORDER_CNT
+   - 1) pages, which is more than Pintos can address. */
+#define BUDDY_ORDER_CNT 20
+
+/* Maximum number of pre-zeroed pages cached per pool. */
+#define ZERO_PAGE_MAX 32
+
+/* Per-page buddy state. */
+struct buddy_page
+  {
+    struct list_elem elem;              /* free_lists[order] element. */
+    int order;                          /* Order of free block, or -1. */
+  };
 
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
-    struct bitmap *used_map;            /* Bitmap of free pages. */
+    struct bitmap *used_map;            /* Bitmap of used pages. */
+    struct buddy_page *pages;           /* Buddy state, one per page. */
+    struct list free_lists[BUDDY_ORDER_CNT]; /* Free blocks by order. */
     uint8_t *base;                      /* Base of pool. */
+    const char *name;                   /* Name, for statistics. */
+
+    /* Statistics. */
+    size_t used_cnt;                    /* Pages allocated, incl. zeroed. */
+    size_t peak_cnt;                    /* Most pages in use at once. */
+    long long fail_cnt;                 /* Failed allocations. */
+
+    /* Pre-zeroed pages. */
+    void *zero_pages[ZERO_PAGE_MAX];    /* Zeroed, allocated pages. */
+    size_t zero_cnt;                    /* Number of ZERO_PAGES. */
+    long long zero_hits;                /* PAL_ZERO served from cache. */
+    long long zero_misses;              /* PAL_ZERO zeroed on demand. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -40,9 +93,20 @@ struct pool kernel_pool, user_pool;
 /* Maximum number of pages to put in user pool. */
 size_t user_page_limit = SIZE_MAX;
 
+/* Upped when a pre-zeroed page is taken, to wake the zeroer. */
+static struct semaphore zero_sema;
+
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
-static bool page_from_pool (const struct pool *, void *page);
+static bool page_from_pool (const struct pool *, const void *page);
+static size_t buddy_alloc (struct pool *, size_t page_cnt);
+static void buddy_free (struct pool *, size_t page_idx, size_t page_cnt);
+static void buddy_free_block (struct pool *, size_t page_idx, int order);
+static void buddy_take (struct pool *, size_t page_idx, size_t page_cnt);
+static thread_func zeroer;
+static bool zero_one_page (struct pool *);
+static void update_peak (struct pool *);
+static void get_pool_stats (const struct pool *, struct memstat_pool *);
 
 /* Initializes the page allocator. */
 void
@@ -66,6 +130,15 @@ palloc_init (void)
   init_pool (&kernel_pool, free_start, kernel_pages, "kernel pool");
   init_pool (&user_pool, free_start + kernel_pages * PGSIZE,
              user_pages, "user pool");
+  sema_init (&zero_sema, 0);
+}
+
+/* Starts the thread that keeps pre-zeroed pages.  Must be called
+   after the thread system is started. */
+void
+palloc_start_zeroer (void) 
+{
+  thread_create ("zeroer", PRI_MIN, zeroer, NULL);
 }
 
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
@@ -78,24 +151,52 @@ void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
-  void *pages;
+  enum intr_level old_level;
+  void *pages = NULL;
+  bool zeroed = false;
   size_t page_idx;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
-
-  if (page_idx != BITMAP_ERROR)
-    pages = pool->base + PGSIZE * page_idx;
+  old_level = intr_disable ();
+  if (page_cnt == 1 && (flags & PAL_ZERO) && pool->zero_cnt > 0)
+    zeroed = true;
   else
-    pages = NULL;
+    {
+      page_idx = buddy_alloc (pool, page_cnt);
+      if (page_idx != BITMAP_ERROR)
+        {
+          ASSERT (bitmap_none (pool->used_map, page_idx, page_cnt));
+          bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+          pages = pool->base + PGSIZE * page_idx;
+        }
+      else if (page_cnt == 1 && pool->zero_cnt > 0)
+        zeroed = true;
+    }
+  if (zeroed)
+    {
+      pages = pool->zero_pages[--pool->zero_cnt];
+      if (flags & PAL_ZERO)
+        pool->zero_hits++;
+    }
+  else if (pages != NULL && (flags & PAL_ZERO))
+    pool->zero_misses++;
+  if (pages != NULL)
+    {
+      if (!zeroed)
+        pool->used_cnt += page_cnt;
+      update_peak (pool);
+    }
+  else
+    pool->fail_cnt++;
+  intr_set_level (old_level);
 
   if (pages != NULL) 
     {
-      if (flags & PAL_ZERO)
+      if (zeroed)
+        sema_up (&zero_sema);
+      else if (flags & PAL_ZERO)
         memset (pages, 0, PGSIZE * page_cnt);
     }
   else 
@@ -125,6 +226,7 @@ void
 palloc_free_multiple (void *pages, size_t page_cnt) 
 {
   struct pool *pool;
+  enum intr_level old_level;
   size_t page_idx;
 
   ASSERT (pg_ofs (pages) == 0);
@@ -144,8 +246,12 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
+  old_level = intr_disable ();
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
   bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  buddy_free (pool, page_idx, page_cnt);
+  pool->used_cnt -= page_cnt;
+  intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -155,31 +261,178 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Tries to grow the group of PAGE_CNT pages at PAGES, obtained
+   from palloc_get_multiple(), to NEW_PAGE_CNT pages by
+   allocating the pages that follow it.  Returns true if
+   successful, false if any of those pages is in use or beyond
+   the end of the pool.  The new pages are not zeroed. */
+bool
+palloc_extend (void *pages, size_t page_cnt, size_t new_page_cnt) 
+{
+  struct pool *pool;
+  enum intr_level old_level;
+  size_t page_idx, add_cnt;
+  bool success = false;
+
+  ASSERT (pg_ofs (pages) == 0);
+  ASSERT (page_cnt > 0);
+  if (new_page_cnt <= page_cnt)
+    return true;
+
+  if (page_from_pool (&kernel_pool, pages))
+    pool = &kernel_pool;
+  else if (page_from_pool (&user_pool, pages))
+    pool = &user_pool;
+  else
+    NOT_REACHED ();
+
+  page_idx = pg_no (pages) - pg_no (pool->base) + page_cnt;
+  add_cnt = new_page_cnt - page_cnt;
+
+  old_level = intr_disable ();
+  if (page_idx + add_cnt <= bitmap_size (pool->used_map)
+      && bitmap_none (pool->used_map, page_idx, add_cnt))
+    {
+      buddy_take (pool, page_idx, add_cnt);
+      bitmap_set_multiple (pool->used_map, page_idx, add_cnt, true);
+      pool->used_cnt += add_cnt;
+      update_peak (pool);
+      success = true;
+    }
+  intr_set_level (old_level);
+
+  return success;
+}
+
+/* Returns the number of pages in the user pool. */
+size_t
+palloc_user_page_cnt (void) 
+{
+  return bitmap_size (user_pool.used_map);
+}
+
+/* Returns the number of user pages that can be allocated right
+   now, counting pre-zeroed pages.  The count is not synchronized
+   with allocation, so it may be out of date by the time the
+   caller looks at it. */
+size_t
+palloc_user_free_cnt (void) 
+{
+  return bitmap_size (user_pool.used_map) - user_pool.used_cnt
+         + user_pool.zero_cnt;
+}
+
+/* Returns the index within the user pool of PAGE, which must
+   have been obtained with PAL_USER.  Indexes run from 0 to
+   palloc_user_page_cnt() - 1, so they can index a table with
+   one entry per user page. */
+size_t
+palloc_user_page_idx (const void *page) 
+{
+  ASSERT (pg_ofs (page) == 0);
+  ASSERT (page_from_pool (&user_pool, page));
+
+  return pg_no (page) - pg_no (user_pool.base);
+}
+
+/* Stores statistics about the kernel and user pools into
+   STATS->kernel and STATS->user. */
+void
+palloc_get_stats (struct memstat *stats) 
+{
+  enum intr_level old_level = intr_disable ();
+  get_pool_stats (&kernel_pool, &stats->kernel);
+  get_pool_stats (&user_pool, &stats->user);
+  intr_set_level (old_level);
+}
+
+/* Prints statistics about each pool and about pre-zeroed
+   pages. */
+void
+palloc_print_stats (void) 
+{
+  struct memstat stats;
+  const struct memstat_pool *p;
+
+  palloc_get_stats (&stats);
+  for (p = &stats.kernel; p <= &stats.user; p++)
+    printf ("Palloc: %s: %"PRIu32" pages, %"PRIu32" used, %"PRIu32" free, "
+            "%"PRIu32" peak, %"PRIu32" failures\n",
+            p == &stats.kernel ? kernel_pool.name : user_pool.name,
+            p->total_pages, p->used_pages, p->free_pages, p->peak_pages,
+            p->failures);
+  printf ("Palloc: %lld pre-zeroed pages used, %lld pages zeroed on demand\n",
+          kernel_pool.zero_hits + user_pool.zero_hits,
+          kernel_pool.zero_misses + user_pool.zero_misses);
+}
+
+/* Updates POOL's peak page usage.  Interrupts must be off. */
+static void
+update_peak (struct pool *pool) 
+{
+  size_t used = pool->used_cnt - pool->zero_cnt;
+
+  if (used > pool->peak_cnt)
+    pool->peak_cnt = used;
+}
+
+/* Stores statistics about POOL into STATS.  Pre-zeroed pages
+   count as free.  Interrupts must be off. */
+static void
+get_pool_stats (const struct pool *pool, struct memstat_pool *stats) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  stats->total_pages = bitmap_size (pool->used_map);
+  stats->used_pages = pool->used_cnt - pool->zero_cnt;
+  stats->free_pages = stats->total_pages - stats->used_pages;
+  stats->peak_pages = pool->peak_cnt;
+  stats->zeroed_pages = pool->zero_cnt;
+  stats->failures = pool->fail_cnt;
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
-  if (bm_pages > page_cnt)
+  /* We'll put the pool's used_map and buddy state at its base.
+     Calculate the space needed for them and subtract it from the
+     pool's size.  (This reserves a little more than needed,
+     since the metadata doesn't cover its own pages.) */
+  size_t bm_size = ROUND_UP (bitmap_buf_size (page_cnt),
+                             sizeof (struct buddy_page));
+  size_t meta_pages = DIV_ROUND_UP (bm_size
+                                    + page_cnt * sizeof (struct buddy_page),
+                                    PGSIZE);
+  size_t i;
+  if (meta_pages > page_cnt)
     PANIC ("Not enough memory in %s for bitmap.", name);
-  page_cnt -= bm_pages;
+  page_cnt -= meta_pages;
 
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
   /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
-  p->base = base + bm_pages * PGSIZE;
+  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_size);
+  p->pages = (struct buddy_page *) ((uint8_t *) base + bm_size);
+  for (i = 0; i < BUDDY_ORDER_CNT; i++)
+    list_init (&p->free_lists[i]);
+  for (i = 0; i < page_cnt; i++)
+    p->pages[i].order = -1;
+  p->base = base + meta_pages * PGSIZE;
+  p->name = name;
+  p->zero_cnt = 0;
+  p->zero_hits = p->zero_misses = 0;
+  p->used_cnt = p->peak_cnt = 0;
+  p->fail_cnt = 0;
+
+  buddy_free (p, 0, page_cnt);
 }
 
 /* Returns true if PAGE was allocated from POOL,
    false otherwise. */
 static bool
-page_from_pool (const struct pool *pool, void *page) 
+page_from_pool (const struct pool *pool, const void *page) 
 {
   size_t page_no = pg_no (page);
   size_t start_page = pg_no (pool->base);
@@ -187,3 +440,187 @@ page_from_pool (const struct pool *pool, void *page)
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Zeroer thread.  Tops up each pool's pre-zeroed pages, then
+   waits until some are used. */
+static void
+zeroer (void *aux UNUSED) 
+{
+  /* Stay out of the way of other threads under every scheduler. */
+  if (thread_mlfqs)
+    thread_set_nice (NICE_MAX);
+  if (thread_stride)
+    thread_set_tickets (TICKETS_MIN);
+
+  for (;;) 
+    {
+      bool kernel_zeroed = zero_one_page (&kernel_pool);
+      bool user_zeroed = zero_one_page (&user_pool);
+      if (!kernel_zeroed && !user_zeroed)
+        sema_down (&zero_sema);
+    }
+}
+
+/* Zeroes a free page from POOL and adds it to POOL's pre-zeroed
+   pages.  Returns true if successful, false if POOL already has
+   ZERO_PAGE_MAX pre-zeroed pages or no free pages. */
+static bool
+zero_one_page (struct pool *pool) 
+{
+  enum intr_level old_level;
+  size_t page_idx;
+  void *page;
+
+  old_level = intr_disable ();
+  if (pool->zero_cnt >= ZERO_PAGE_MAX)
+    page_idx = BITMAP_ERROR;
+  else
+    page_idx = buddy_alloc (pool, 1);
+  if (page_idx != BITMAP_ERROR)
+    {
+      bitmap_mark (pool->used_map, page_idx);
+      pool->used_cnt++;
+    }
+  intr_set_level (old_level);
+  if (page_idx == BITMAP_ERROR)
+    return false;
+
+  /* Only the zeroer adds pages, so there is still room. */
+  page = pool->base + PGSIZE * page_idx;
+  memset (page, 0, PGSIZE);
+  old_level = intr_disable ();
+  pool->zero_pages[pool->zero_cnt++] = page;
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL's buddy free
+   lists and returns the index of the first one, or BITMAP_ERROR
+   if no block is large enough.  Interrupts must be off. */
+static size_t
+buddy_alloc (struct pool *pool, size_t page_cnt) 
+{
+  struct buddy_page *bp;
+  size_t page_idx;
+  int order, i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* Find the smallest order that fits, then the smallest
+     non-empty free list at or above it. */
+  for (order = 0; (size_t) 1 << order < page_cnt; order++)
+    if (order + 1 >= BUDDY_ORDER_CNT)
+      return BITMAP_ERROR;
+  for (i = order; i < BUDDY_ORDER_CNT; i++)
+    if (!list_empty (&pool->free_lists[i]))
+      break;
+  if (i >= BUDDY_ORDER_CNT)
+    return BITMAP_ERROR;
+
+  bp = list_entry (list_pop_front (&pool->free_lists[i]),
+                   struct buddy_page, elem);
+  bp->order = -1;
+  page_idx = bp - pool->pages;
+
+  /* Split the block down to ORDER, freeing the upper halves. */
+  while (i > order)
+    {
+      i--;
+      bp = &pool->pages[page_idx + ((size_t) 1 << i)];
+      bp->order = i;
+      list_push_front (&pool->free_lists[i], &bp->elem);
+    }
+
+  /* Give back the pages beyond PAGE_CNT. */
+  buddy_free (pool, page_idx + page_cnt, ((size_t) 1 << order) - page_cnt);
+
+  return page_idx;
+}
+
+/* Returns the PAGE_CNT pages starting at PAGE_IDX to POOL's free
+   lists, as the largest aligned blocks that tile the range.
+   Interrupts must be off, except during initialization. */
+static void
+buddy_free (struct pool *pool, size_t page_idx, size_t page_cnt) 
+{
+  while (page_cnt > 0)
+    {
+      int order = 0;
+
+      while (order + 1 < BUDDY_ORDER_CNT
+             && page_idx % ((size_t) 2 << order) == 0
+             && (size_t) 2 << order <= page_cnt)
+        order++;
+
+      buddy_free_block (pool, page_idx, order);
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+    }
+}
+
+/* Removes the PAGE_CNT free pages starting at PAGE_IDX from
+   POOL's free lists, splitting the free blocks that contain them
+   and returning the parts outside the range.  Interrupts must be
+   off. */
+static void
+buddy_take (struct pool *pool, size_t page_idx, size_t page_cnt) 
+{
+  size_t end = page_idx + page_cnt;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (page_idx < end)
+    {
+      size_t block_idx, block_end;
+      int order;
+
+      /* Find the free block that contains PAGE_IDX. */
+      for (order = 0; ; order++)
+        {
+          ASSERT (order < BUDDY_ORDER_CNT);
+          block_idx = page_idx & ~(((size_t) 1 << order) - 1);
+          if (pool->pages[block_idx].order == order)
+            break;
+        }
+      block_end = block_idx + ((size_t) 1 << order);
+
+      /* Take the whole block, then give back what's outside the
+         range. */
+      list_remove (&pool->pages[block_idx].elem);
+      pool->pages[block_idx].order = -1;
+      buddy_free (pool, block_idx, page_idx - block_idx);
+      if (block_end > end)
+        buddy_free (pool, end, block_end - end);
+
+      page_idx = block_end;
+    }
+}
+
+/* Frees the block of 2**ORDER pages at PAGE_IDX in POOL,
+   merging it with its buddy for as long as the buddy is free. */
+static void
+buddy_free_block (struct pool *pool, size_t page_idx, int order) 
+{
+  size_t page_cnt = bitmap_size (pool->used_map);
+  struct buddy_page *bp;
+
+  while (order + 1 < BUDDY_ORDER_CNT)
+    {
+      size_t buddy_idx = page_idx ^ ((size_t) 1 << order);
+      struct buddy_page *buddy = &pool->pages[buddy_idx];
+
+      if (buddy_idx + ((size_t) 1 << order) > page_cnt
+          || buddy->order != order)
+        break;
+
+      list_remove (&buddy->elem);
+      buddy->order = -1;
+      if (buddy_idx < page_idx)
+        page_idx = buddy_idx;
+      order++;
+    }
+
+  bp = &pool->pages[page_idx];
+  bp->order = order;
+  list_push_front (&pool->free_lists[order], &bp->elem);
+}
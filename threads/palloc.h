@@ -1,7 +1,9 @@
 #ifndef THREADS_PALLOC_H
 #define THREADS_PALLOC_H
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <memstat.h>
 
 /* How to allocate pages. */
 enum palloc_flags
@@ -15,9 +17,16 @@ enum palloc_flags
 extern size_t user_page_limit;
 
 void palloc_init (void);
+void palloc_start_zeroer (void);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+bool palloc_extend (void *, size_t page_cnt, size_t new_page_cnt);
+size_t palloc_user_page_cnt (void);
+size_t palloc_user_free_cnt (void);
+size_t palloc_user_page_idx (const void *);
+void palloc_get_stats (struct memstat *);
+void palloc_print_stats (void);
 
 #endif /* threads/palloc.h */
@@ -0,0 +1,297 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Object cache allocator.
+
+   Each cache gets slabs of one page apiece from the page
+   allocator.  A slab begins with a header, followed by as many
+   objects as fit.  Free objects within a slab are kept on a
+   singly linked list threaded through the objects themselves.
+   The cache keeps a list of slabs that have at least one free
+   object, so allocation takes the first object from the first
+   such slab.  Freeing an object finds its slab by rounding its
+   address down to a page boundary.
+
+   A slab whose objects are all free is given back to the page
+   allocator, except that each cache keeps one empty slab around
+   so that a caller that repeatedly allocates and frees a single
+   object doesn't go to the page allocator every time.
+
+   Cache descriptors come from a fixed table, so caches may be
+   created before malloc_init() or palloc_init() has been called.
+   Slabs are not allocated until the first kmem_cache_alloc(). */
+
+/* Maximum number of caches. */
+#define CACHE_MAX 32
+
+/* Object cache. */
+struct kmem_cache
+  {
+    const char *name;           /* Name, for statistics. */
+    size_t size;                /* Object size, after alignment. */
+    size_t objs_per_slab;       /* Objects in each slab. */
+    kmem_ctor_func *ctor;       /* Constructor, or null. */
+    struct lock lock;           /* Protects everything below. */
+    struct list slabs;          /* Slabs with free objects. */
+    size_t empty_cnt;           /* Slabs on SLABS with no objects used. */
+
+    /* Statistics. */
+    size_t slab_cnt;            /* Slabs now allocated. */
+    size_t peak_slab_cnt;       /* Most slabs allocated at once. */
+    size_t in_use;              /* Objects now allocated. */
+    size_t peak_in_use;         /* Most objects allocated at once. */
+    long long alloc_cnt;        /* Calls to kmem_cache_alloc(). */
+  };
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Slab header, at the beginning of each slab's page. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct kmem_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* Element in cache's SLABS list. */
+    size_t free_cnt;            /* Number of free objects. */
+    void *free_list;            /* First free object. */
+  };
+
+/* Objects are aligned on this boundary, which is also the
+   minimum object size, since a free object holds a pointer. */
+#define OBJ_ALIGN sizeof (void *)
+
+/* Offset of the first object in a slab. */
+#define SLAB_HDR_SIZE ROUND_UP (sizeof (struct slab), OBJ_ALIGN)
+
+static struct kmem_cache caches[CACHE_MAX];     /* Cache descriptors. */
+static size_t cache_cnt;                        /* Caches in use. */
+static struct lock caches_lock;                 /* Protects CACHE_CNT. */
+
+static struct slab *slab_create (struct kmem_cache *);
+static struct slab *object_to_slab (struct kmem_cache *, void *);
+static size_t malloc_footprint (size_t size, size_t cnt);
+
+/* Creates and returns a cache of objects of SIZE bytes, named
+   NAME for statistics.  If CTOR is nonnull, it is called on each
+   object as it is allocated.  Panics if there are too many
+   caches or if SIZE is too big for an object to fit in a slab,
+   since both are programming errors.  Caches cannot be
+   destroyed. */
+struct kmem_cache *
+kmem_cache_create (const char *name, size_t size, kmem_ctor_func *ctor)
+{
+  struct kmem_cache *c;
+
+  ASSERT (name != NULL);
+  ASSERT (size > 0);
+
+  size = ROUND_UP (size, OBJ_ALIGN);
+  if (size > PGSIZE - SLAB_HDR_SIZE)
+    PANIC ("%s: %zu-byte objects do not fit in a slab", name, size);
+
+  /* CACHES_LOCK is initialized here, the first time, because
+     the first cache may be created before anything else could
+     initialize it.  The kernel is single-threaded then. */
+  if (cache_cnt == 0)
+    lock_init (&caches_lock);
+  lock_acquire (&caches_lock);
+  if (cache_cnt >= CACHE_MAX)
+    PANIC ("%s: too many object caches", name);
+  c = &caches[cache_cnt++];
+  lock_release (&caches_lock);
+
+  c->name = name;
+  c->size = size;
+  c->objs_per_slab = (PGSIZE - SLAB_HDR_SIZE) / size;
+  c->ctor = ctor;
+  lock_init_named (&c->lock, name);
+  list_init (&c->slabs);
+  c->empty_cnt = 0;
+  c->slab_cnt = c->peak_slab_cnt = 0;
+  c->in_use = c->peak_in_use = 0;
+  c->alloc_cnt = 0;
+  return c;
+}
+
+/* Obtains and returns a new object from cache C.  Returns a null
+   pointer if memory is not available. */
+void *
+kmem_cache_alloc (struct kmem_cache *c)
+{
+  struct slab *s;
+  void *object;
+
+  lock_acquire (&c->lock);
+
+  /* If no slab has a free object, create a new slab. */
+  if (list_empty (&c->slabs))
+    {
+      s = slab_create (c);
+      if (s == NULL)
+        {
+          lock_release (&c->lock);
+          return NULL;
+        }
+      list_push_front (&c->slabs, &s->elem);
+      c->empty_cnt++;
+    }
+
+  /* Take an object from the first slab. */
+  s = list_entry (list_front (&c->slabs), struct slab, elem);
+  if (s->free_cnt == c->objs_per_slab)
+    c->empty_cnt--;
+  object = s->free_list;
+  s->free_list = *(void **) object;
+  if (--s->free_cnt == 0)
+    list_remove (&s->elem);
+
+  c->alloc_cnt++;
+  if (++c->in_use > c->peak_in_use)
+    c->peak_in_use = c->in_use;
+  lock_release (&c->lock);
+
+  if (c->ctor != NULL)
+    c->ctor (object);
+  return object;
+}
+
+/* Frees OBJECT, which must have been allocated from cache C.
+   Does nothing if OBJECT is a null pointer. */
+void
+kmem_cache_free (struct kmem_cache *c, void *object)
+{
+  struct slab *s;
+
+  if (object == NULL)
+    return;
+
+  s = object_to_slab (c, object);
+
+#ifndef NDEBUG
+  /* Clear the object to help detect use-after-free bugs. */
+  memset (object, 0xcc, c->size);
+#endif
+
+  lock_acquire (&c->lock);
+
+  /* Return the object to its slab, putting the slab back on the
+     list of slabs with free objects if it was full. */
+  *(void **) object = s->free_list;
+  s->free_list = object;
+  if (s->free_cnt++ == 0)
+    list_push_front (&c->slabs, &s->elem);
+  c->in_use--;
+
+  /* If the slab is now empty, free it, unless it is the only
+     empty slab. */
+  if (s->free_cnt == c->objs_per_slab)
+    {
+      if (c->empty_cnt > 0)
+        {
+          list_remove (&s->elem);
+          s->magic = 0;
+          palloc_free_page (s);
+          c->slab_cnt--;
+        }
+      else
+        c->empty_cnt++;
+    }
+
+  lock_release (&c->lock);
+}
+
+/* Prints statistics for each cache, comparing the memory used
+   at peak with what malloc() would have used for the same
+   objects. */
+void
+kmem_print_stats (void)
+{
+  size_t i;
+
+  for (i = 0; i < cache_cnt; i++)
+    {
+      struct kmem_cache *c = &caches[i];
+
+      if (c->alloc_cnt == 0)
+        continue;
+      printf ("Slab %s: %lld allocs, %zu in use, peak %zu "
+              "%zu-byte objects in %zu pages (malloc: %zu pages)\n",
+              c->name, c->alloc_cnt, c->in_use, c->peak_in_use, c->size,
+              c->peak_slab_cnt, malloc_footprint (c->size, c->peak_in_use));
+    }
+}
+
+/* Allocates and initializes a new, empty slab for cache C, which
+   must be locked.  Returns the slab, or a null pointer if no
+   page is available. */
+static struct slab *
+slab_create (struct kmem_cache *c)
+{
+  struct slab *s;
+  uint8_t *object;
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&c->lock));
+
+  s = palloc_get_page (0);
+  if (s == NULL)
+    return NULL;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = c;
+  s->free_cnt = c->objs_per_slab;
+  s->free_list = NULL;
+  object = (uint8_t *) s + SLAB_HDR_SIZE + c->objs_per_slab * c->size;
+  for (i = 0; i < c->objs_per_slab; i++)
+    {
+      object -= c->size;
+      *(void **) object = s->free_list;
+      s->free_list = object;
+    }
+
+  if (++c->slab_cnt > c->peak_slab_cnt)
+    c->peak_slab_cnt = c->slab_cnt;
+  return s;
+}
+
+/* Returns the slab that OBJECT, from cache C, is inside. */
+static struct slab *
+object_to_slab (struct kmem_cache *c, void *object)
+{
+  struct slab *s = pg_round_down (object);
+
+  /* Check that the slab is valid and belongs to C. */
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT (s->cache == c);
+
+  /* Check that the object is properly aligned for the slab. */
+  ASSERT (pg_ofs (object) >= SLAB_HDR_SIZE);
+  ASSERT ((pg_ofs (object) - SLAB_HDR_SIZE) % c->size == 0);
+
+  return s;
+}
+
+/* Returns the number of pages that malloc() would use for CNT
+   objects of SIZE bytes, following the scheme in malloc.c. */
+static size_t
+malloc_footprint (size_t size, size_t cnt)
+{
+  /* Header at the beginning of each malloc() arena. */
+  const size_t arena_size = sizeof (unsigned) + sizeof (void *)
+                            + sizeof (size_t);
+  size_t block_size;
+
+  for (block_size = 16; block_size < size; block_size *= 2)
+    continue;
+  if (block_size >= PGSIZE / 2)
+    return cnt * DIV_ROUND_UP (size + arena_size, PGSIZE);
+  return DIV_ROUND_UP (cnt, (PGSIZE - arena_size) / block_size);
+}
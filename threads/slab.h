@@ -0,0 +1,24 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <stddef.h>
+
+/* Object caches for fixed-size kernel objects.
+
+   malloc() rounds every request up to a power of 2, so that, for
+   example, a 60-byte object occupies a 64-byte block and a
+   540-byte one a 1024-byte block.  An object cache instead packs
+   objects of a single size into whole pages ("slabs") at their
+   exact size, rounded up only for alignment. */
+
+/* Constructor for the objects in a cache.  Called on each object
+   as it is allocated, before kmem_cache_alloc() returns it. */
+typedef void kmem_ctor_func (void *object);
+
+struct kmem_cache *kmem_cache_create (const char *name, size_t size,
+                                      kmem_ctor_func *);
+void *kmem_cache_alloc (struct kmem_cache *);
+void kmem_cache_free (struct kmem_cache *, void *);
+void kmem_print_stats (void);
+
+#endif /* threads/slab.h */
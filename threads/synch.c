@@ -27,10 +27,48 @@
 */
 
 #include "threads/synch.h"
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/tsc.h"
+
+/* Maximum length of a chain of lock holders that a donation is
+   propagated along. */
+#define DONATION_DEPTH_MAX 8
+
+static bool priority_more (const struct list_elem *,
+                           const struct list_elem *, void *);
+static void donate_priority (struct thread *donor);
+
+#ifdef LOCK_PROFILE
+/* Lock contention statistics, shared by all the locks with the
+   same name. */
+struct lock_profile
+  {
+    const char *name;           /* Name given to lock_init_named(). */
+    long long acquire_cnt;      /* # of acquisitions. */
+    long long contended_cnt;    /* # of acquisitions that waited. */
+    uint64_t wait_cycles;       /* Total cycles spent waiting. */
+    uint64_t max_wait_cycles;   /* Longest wait, in cycles. */
+    uint64_t max_hold_cycles;   /* Longest hold, in cycles. */
+  };
+
+/* Statistics for each distinct lock name.  Locks initialized
+   once this table is full are not profiled. */
+#define LOCK_PROFILE_CNT 64
+static struct lock_profile lock_profiles[LOCK_PROFILE_CNT];
+static size_t lock_profile_cnt;
+
+/* Number of locks listed by lock_print_stats(). */
+#define LOCK_REPORT_CNT 10
+
+static struct lock_profile *lock_profile_find (const char *name);
+static void lock_profile_acquired (struct lock *, bool contended,
+                                   uint64_t wait_cycles);
+static void lock_profile_released (struct lock *);
+#endif
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -56,11 +94,14 @@ sema_init (struct semaphore *sema, unsigned value)
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but if it sleeps then the next scheduled
-   thread will probably turn interrupts back on. This is
-   sema_down function. */
+   thread will probably turn interrupts back on.
+
+   Waiters are kept in descending order of priority, FIFO among
+   equal priorities, so that sema_up() wakes the front one. */
 void
 sema_down (struct semaphore *sema) 
 {
+  struct thread *t = thread_current ();
   enum intr_level old_level;
 
   ASSERT (sema != NULL);
@@ -69,7 +110,8 @@ sema_down (struct semaphore *sema)
   old_level = intr_disable ();
   while (sema->value == 0) 
     {
-      list_push_back (&sema->waiters, &thread_current ()->elem);
+      list_insert_ordered (&sema->waiters, &t->elem, priority_more, NULL);
+      t->wait_sema = sema;
       thread_block ();
     }
   sema->value--;
@@ -104,6 +146,8 @@ sema_try_down (struct semaphore *sema)
 
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
    and wakes up one thread of those waiting for SEMA, if any.
+   Yields if the woken thread has a higher priority than the
+   running thread.
 
    This function may be called from an interrupt handler. */
 void
@@ -115,10 +159,31 @@ sema_up (struct semaphore *sema)
 
   old_level = intr_disable ();
   if (!list_empty (&sema->waiters)) 
-    thread_unblock (list_entry (list_pop_front (&sema->waiters),
-                                struct thread, elem));
+    {
+      struct thread *t = list_entry (list_pop_front (&sema->waiters),
+                                     struct thread, elem);
+      t->wait_sema = NULL;
+      thread_unblock (t);
+    }
   sema->value++;
   intr_set_level (old_level);
+
+  thread_preempt ();
+}
+
+/* Moves T, which is blocked on a semaphore, to its place among
+   the semaphore's waiters after a change in T's priority, so
+   that sema_up() still wakes the highest-priority waiter.  Must
+   be called with interrupts off. */
+void
+sema_requeue (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->status == THREAD_BLOCKED && t->wait_sema != NULL);
+
+  list_remove (&t->elem);
+  list_insert_ordered (&t->wait_sema->waiters, &t->elem,
+                       priority_more, NULL);
 }
 
 static void sema_test_helper (void *sema_);
@@ -172,14 +237,37 @@ sema_test_helper (void *sema_)
    another one "up" it, but with a lock the same thread must both
    acquire and release it.  When these restrictions prove
    onerous, it's a good sign that a semaphore should be used,
-   instead of a lock. */
+   instead of a lock.
+
+   NAME, which must remain valid forever, identifies the lock in
+   contention statistics.  Usually lock_init() supplies it. */
 void
-lock_init (struct lock *lock)
+lock_init_named (struct lock *lock, const char *name UNUSED)
 {
   ASSERT (lock != NULL);
 
   lock->holder = NULL;
   sema_init (&lock->semaphore, 1);
+#ifdef LOCK_PROFILE
+  lock->profile = lock_profile_find (name);
+#endif
+}
+
+/* Makes LOCK held by the current thread, which just downed its
+   semaphore.  Must be called with interrupts off. */
+static void
+lock_take (struct lock *lock)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  lock->holder = t;
+  list_push_back (&t->locks, &lock->elem);
+
+  /* Threads still waiting for LOCK now donate to us. */
+  if (!thread_mlfqs)
+    thread_refresh_priority (t);
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
@@ -189,16 +277,42 @@ lock_init (struct lock *lock)
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
-   we need to sleep. */
+   we need to sleep.
+
+   If LOCK is held, the current thread donates its priority to
+   the holder, and through it along the chain of lock holders
+   that the holder is itself waiting on. */
 void
 lock_acquire (struct lock *lock)
 {
+  struct thread *t = thread_current ();
+  enum intr_level old_level;
+#ifdef LOCK_PROFILE
+  uint64_t start;
+  bool contended;
+#endif
+
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
+#ifdef LOCK_PROFILE
+  start = rdtsc ();
+  contended = lock->holder != NULL;
+#endif
+  if (lock->holder != NULL && !thread_mlfqs)
+    {
+      t->wait_lock = lock;
+      donate_priority (t);
+    }
   sema_down (&lock->semaphore);
-  lock->holder = thread_current ();
+  t->wait_lock = NULL;
+  lock_take (lock);
+#ifdef LOCK_PROFILE
+  lock_profile_acquired (lock, contended, rdtsc () - start);
+#endif
+  intr_set_level (old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -217,12 +331,21 @@ lock_try_acquire (struct lock *lock)
 
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    {
+      enum intr_level old_level = intr_disable ();
+      lock_take (lock);
+#ifdef LOCK_PROFILE
+      lock_profile_acquired (lock, false, 0);
+#endif
+      intr_set_level (old_level);
+    }
   return success;
 }
 
 /* Releases LOCK, which must be owned by the current thread.
-   This is lock_release function.
+   The current thread gives up the priority donated through LOCK,
+   falling back to the highest donation among the locks it still
+   holds, or to its base priority.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
@@ -230,10 +353,22 @@ lock_try_acquire (struct lock *lock)
 void
 lock_release (struct lock *lock) 
 {
+  struct thread *t = thread_current ();
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
+#ifdef LOCK_PROFILE
+  lock_profile_released (lock);
+#endif
   lock->holder = NULL;
+  list_remove (&lock->elem);
+  if (!thread_mlfqs)
+    thread_refresh_priority (t);
+  intr_set_level (old_level);
+
   sema_up (&lock->semaphore);
 }
 
@@ -247,14 +382,171 @@ lock_held_by_current_thread (const struct lock *lock)
 
   return lock->holder == thread_current ();
 }
+
+/* Prints lock contention statistics for the LOCK_REPORT_CNT
+   most contended lock names, if the kernel was compiled with
+   LOCK_PROFILE defined. */
+void
+lock_print_stats (void)
+{
+#ifdef LOCK_PROFILE
+  struct lock_profile *top[LOCK_REPORT_CNT];
+  size_t top_cnt = 0;
+  size_t i, j;
+
+  /* Insertion sort into TOP, most contended first, breaking ties
+     by total wait. */
+  for (i = 0; i < lock_profile_cnt; i++)
+    {
+      struct lock_profile *p = &lock_profiles[i];
+
+      for (j = top_cnt; j > 0; j--)
+        {
+          struct lock_profile *q = top[j - 1];
+          if (q->contended_cnt > p->contended_cnt
+              || (q->contended_cnt == p->contended_cnt
+                  && q->wait_cycles >= p->wait_cycles))
+            break;
+          if (j < LOCK_REPORT_CNT)
+            top[j] = q;
+        }
+      if (j < LOCK_REPORT_CNT)
+        {
+          top[j] = p;
+          if (top_cnt < LOCK_REPORT_CNT)
+            top_cnt++;
+        }
+    }
+
+  printf ("Lock: %zu lock names profiled, top %zu by contention:\n",
+          lock_profile_cnt, top_cnt);
+  for (i = 0; i < top_cnt; i++)
+    printf ("Lock: %s: %lld acquired, %lld contended, "
+            "%"PRIu64" wait cycles (max %"PRIu64"), "
+            "max hold %"PRIu64" cycles\n",
+            top[i]->name, top[i]->acquire_cnt, top[i]->contended_cnt,
+            top[i]->wait_cycles, top[i]->max_wait_cycles,
+            top[i]->max_hold_cycles);
+#endif
+}
+
+#ifdef LOCK_PROFILE
+/* Returns the statistics for locks named NAME, creating them if
+   necessary, or a null pointer if there is no room for them. */
+static struct lock_profile *
+lock_profile_find (const char *name)
+{
+  struct lock_profile *p = NULL;
+  enum intr_level old_level;
+  size_t i;
+
+  old_level = intr_disable ();
+  for (i = 0; i < lock_profile_cnt; i++)
+    if (!strcmp (lock_profiles[i].name, name))
+      {
+        p = &lock_profiles[i];
+        break;
+      }
+  if (p == NULL && lock_profile_cnt < LOCK_PROFILE_CNT)
+    {
+      p = &lock_profiles[lock_profile_cnt++];
+      p->name = name;
+    }
+  intr_set_level (old_level);
+
+  return p;
+}
+
+/* Records that the current thread acquired LOCK after waiting
+   WAIT_CYCLES, and whether it had to wait for another holder.
+   Must be called with interrupts off. */
+static void
+lock_profile_acquired (struct lock *lock, bool contended,
+                       uint64_t wait_cycles)
+{
+  struct lock_profile *p = lock->profile;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  lock->acquire_tsc = rdtsc ();
+  if (p == NULL)
+    return;
+  p->acquire_cnt++;
+  if (contended)
+    {
+      p->contended_cnt++;
+      p->wait_cycles += wait_cycles;
+      if (wait_cycles > p->max_wait_cycles)
+        p->max_wait_cycles = wait_cycles;
+    }
+}
+
+/* Records that the current thread is releasing LOCK.  Must be
+   called with interrupts off. */
+static void
+lock_profile_released (struct lock *lock)
+{
+  struct lock_profile *p = lock->profile;
+  uint64_t hold_cycles;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (p == NULL)
+    return;
+  hold_cycles = rdtsc () - lock->acquire_tsc;
+  if (hold_cycles > p->max_hold_cycles)
+    p->max_hold_cycles = hold_cycles;
+}
+#endif /* LOCK_PROFILE */
+
+/* Propagates DONOR's priority to the holder of the lock DONOR is
+   waiting for, and on through each holder that is itself waiting
+   for a lock, up to DONATION_DEPTH_MAX holders deep.  Stops early
+   at a holder that already runs at least at DONOR's priority.
+   Must be called with interrupts off. */
+static void
+donate_priority (struct thread *donor)
+{
+  int priority = donor->priority;
+  struct lock *lock = donor->wait_lock;
+  int depth;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (depth = 0; lock != NULL && depth < DONATION_DEPTH_MAX; depth++)
+    {
+      struct thread *holder = lock->holder;
+
+      if (holder == NULL || holder->priority >= priority)
+        break;
+      thread_change_priority (holder, priority);
+      lock = holder->wait_lock;
+    }
+}
+
+/* Returns true if the thread for list element A_ has a higher
+   priority than the one for B_. */
+static bool
+priority_more (const struct list_elem *a_, const struct list_elem *b_,
+               void *aux UNUSED)
+{
+  const struct thread *a = list_entry (a_, struct thread, elem);
+  const struct thread *b = list_entry (b_, struct thread, elem);
+
+  return a->priority > b->priority;
+}
 
 /* One semaphore in a list. */
 struct semaphore_elem 
   {
     struct list_elem elem;              /* List element. */
     struct semaphore semaphore;         /* This semaphore. */
+    struct thread *thread;              /* Waiting thread. */
   };
 
+static bool waiter_priority_less (const struct list_elem *,
+                                  const struct list_elem *, void *);
+
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -285,7 +577,11 @@ cond_init (struct condition *cond)
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
-   we need to sleep. */
+   we need to sleep.
+
+   Waiters are kept in the order they began waiting.  A waiter's
+   priority may change while it waits, through donation or the
+   MLFQS, so cond_signal() compares their current priorities. */
 void
 cond_wait (struct condition *cond, struct lock *lock) 
 {
@@ -297,6 +593,7 @@ cond_wait (struct condition *cond, struct lock *lock)
   ASSERT (lock_held_by_current_thread (lock));
   
   sema_init (&waiter.semaphore, 0);
+  waiter.thread = thread_current ();
   list_push_back (&cond->waiters, &waiter.elem);
   lock_release (lock);
   sema_down (&waiter.semaphore);
@@ -304,7 +601,8 @@ cond_wait (struct condition *cond, struct lock *lock)
 }
 
 /* If any threads are waiting on COND (protected by LOCK), then
-   this function signals one of them to wake up from its wait.
+   this function signals the highest-priority one to wake up from
+   its wait.
    LOCK must be held before calling this function.
 
    An interrupt handler cannot acquire a lock, so it does not
@@ -319,8 +617,12 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
   ASSERT (lock_held_by_current_thread (lock));
 
   if (!list_empty (&cond->waiters)) 
-    sema_up (&list_entry (list_pop_front (&cond->waiters),
-                          struct semaphore_elem, elem)->semaphore);
+    {
+      struct list_elem *e = list_max (&cond->waiters,
+                                      waiter_priority_less, NULL);
+      list_remove (e);
+      sema_up (&list_entry (e, struct semaphore_elem, elem)->semaphore);
+    }
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -338,3 +640,170 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   while (!list_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Initializes RWLOCK.  A reader-writer lock can be held by any
+   number of readers at once or by a single writer.
+
+   A writer holds RWLOCK's inner lock for as long as it holds
+   RWLOCK, and a reader briefly acquires the inner lock on the
+   way in.  Thus, a writer that is waiting for the readers to
+   leave keeps new readers out, so that a steady stream of
+   readers cannot starve writers.  Readers and writers waiting
+   for the inner lock are served in priority order, and donate
+   their priority to a writer that holds it.  (Readers, which
+   hold only a count, do not receive donations.) */
+void
+rwlock_init (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+
+  lock_init (&rwlock->lock);
+  rwlock->reader_cnt = 0;
+  rwlock->writer_waiting = false;
+  sema_init (&rwlock->drained, 0);
+}
+
+/* Acquires RWLOCK for reading, sleeping until no writer holds it
+   or waits for it ahead of us.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_read_acquire (struct rwlock *rwlock)
+{
+  enum intr_level old_level;
+
+  ASSERT (rwlock != NULL);
+  ASSERT (!intr_context ());
+
+  lock_acquire (&rwlock->lock);
+  old_level = intr_disable ();
+  rwlock->reader_cnt++;
+  intr_set_level (old_level);
+  lock_release (&rwlock->lock);
+}
+
+/* Releases RWLOCK, which the current thread holds for reading.
+   If this is the last reader and a writer is waiting for it,
+   wakes the writer. */
+void
+rwlock_read_release (struct rwlock *rwlock)
+{
+  enum intr_level old_level;
+
+  ASSERT (rwlock != NULL);
+
+  old_level = intr_disable ();
+  ASSERT (rwlock->reader_cnt > 0);
+  if (--rwlock->reader_cnt == 0 && rwlock->writer_waiting)
+    {
+      rwlock->writer_waiting = false;
+      sema_up (&rwlock->drained);
+    }
+  intr_set_level (old_level);
+}
+
+/* Acquires RWLOCK for writing, sleeping until no other thread
+   holds it.  RWLOCK must not already be held by the current
+   thread.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_write_acquire (struct rwlock *rwlock)
+{
+  enum intr_level old_level;
+
+  ASSERT (rwlock != NULL);
+  ASSERT (!intr_context ());
+
+  lock_acquire (&rwlock->lock);
+  old_level = intr_disable ();
+  if (rwlock->reader_cnt > 0)
+    {
+      rwlock->writer_waiting = true;
+      sema_down (&rwlock->drained);
+    }
+  intr_set_level (old_level);
+}
+
+/* Releases RWLOCK, which the current thread holds for writing. */
+void
+rwlock_write_release (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+
+  lock_release (&rwlock->lock);
+}
+
+/* Tries to turn the current thread's read hold on RWLOCK into a
+   write hold, without letting any other writer in between.
+   Returns true if successful.  Fails, returning false with
+   RWLOCK still held for reading, if a writer holds or is waiting
+   for RWLOCK; a caller that must write anyway should release its
+   read hold and acquire RWLOCK for writing, then recheck
+   whatever it read.
+
+   This function may sleep waiting for other readers to leave,
+   so it must not be called within an interrupt handler. */
+bool
+rwlock_try_upgrade (struct rwlock *rwlock)
+{
+  enum intr_level old_level;
+
+  ASSERT (rwlock != NULL);
+  ASSERT (!intr_context ());
+
+  if (!lock_try_acquire (&rwlock->lock))
+    return false;
+
+  old_level = intr_disable ();
+  ASSERT (rwlock->reader_cnt > 0);
+  if (--rwlock->reader_cnt > 0)
+    {
+      rwlock->writer_waiting = true;
+      sema_down (&rwlock->drained);
+    }
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Turns the current thread's write hold on RWLOCK into a read
+   hold, letting in the readers waiting for it but no writer. */
+void
+rwlock_downgrade (struct rwlock *rwlock)
+{
+  enum intr_level old_level;
+
+  ASSERT (rwlock != NULL);
+  ASSERT (lock_held_by_current_thread (&rwlock->lock));
+
+  old_level = intr_disable ();
+  rwlock->reader_cnt++;
+  intr_set_level (old_level);
+  lock_release (&rwlock->lock);
+}
+
+/* Returns true if the current thread holds RWLOCK for writing,
+   false otherwise. */
+bool
+rwlock_write_held_by_current_thread (const struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+
+  return lock_held_by_current_thread (&rwlock->lock);
+}
+
+/* Returns true if the waiter for list element A_ has a lower
+   priority than the one for B_. */
+static bool
+waiter_priority_less (const struct list_elem *a_,
+                      const struct list_elem *b_, void *aux UNUSED)
+{
+  const struct semaphore_elem *a
+    = list_entry (a_, struct semaphore_elem, elem);
+  const struct semaphore_elem *b
+    = list_entry (b_, struct semaphore_elem, elem);
+
+  return a->thread->priority < b->thread->priority;
+}
@@ -3,6 +3,9 @@
 
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
+
+struct thread;
 
 /* A counting semaphore. */
 struct semaphore 
@@ -15,20 +18,31 @@ void sema_init (struct semaphore *, unsigned value);
 void sema_down (struct semaphore *);
 bool sema_try_down (struct semaphore *);
 void sema_up (struct semaphore *);
+void sema_requeue (struct thread *);
 void sema_self_test (void);
 
 /* Lock. */
 struct lock 
   {
-    struct thread *holder;      /* Thread holding lock (for debugging). */
+    struct thread *holder;      /* Thread holding lock. */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+    struct list_elem elem;      /* Element in holder's `locks' list. */
+#ifdef LOCK_PROFILE
+    struct lock_profile *profile; /* Statistics, or a null pointer. */
+    uint64_t acquire_tsc;       /* When the holder acquired the lock. */
+#endif
   };
 
-void lock_init (struct lock *);
+void lock_init_named (struct lock *, const char *name);
 void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
+void lock_print_stats (void);
+
+/* Initializes LOCK, naming it after the expression used to
+   designate it, e.g. "&frame_table_lock". */
+#define lock_init(LOCK) lock_init_named (LOCK, #LOCK)
 
 /* Condition variable. */
 struct condition 
@@ -41,6 +55,24 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Reader-writer lock. */
+struct rwlock
+  {
+    struct lock lock;           /* Held by the writer, if any. */
+    unsigned reader_cnt;        /* Number of readers holding the lock. */
+    bool writer_waiting;        /* Writer waiting for readers to leave? */
+    struct semaphore drained;   /* Upped when the last reader leaves. */
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_read_acquire (struct rwlock *);
+void rwlock_read_release (struct rwlock *);
+void rwlock_write_acquire (struct rwlock *);
+void rwlock_write_release (struct rwlock *);
+bool rwlock_try_upgrade (struct rwlock *);
+void rwlock_downgrade (struct rwlock *);
+bool rwlock_write_held_by_current_thread (const struct rwlock *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
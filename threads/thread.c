@@ -1,16 +1,22 @@
 #include "threads/thread.h"
 #include <debug.h>
+#include <inttypes.h>
 #include <stddef.h>
 #include <random.h>
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
+#include "threads/tsc.h"
 #include "threads/vaddr.h"
+#include "devices/timer.h"
 
 #include "vm/page.h"
 #include "vm/swap.h"
@@ -20,7 +26,7 @@
 #include "userprog/process.h"
 #endif
 
-struct semaphore file_sema;
+struct lock file_lock;
 
 /* Random value for struct thread's `magic' member.
    Used to detect stack overflow.  See the big comment at the top
@@ -31,9 +37,21 @@ struct semaphore file_sema;
    Do not modify this value. */
 #define THREAD_BASIC 0xd42df210
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Run queues of processes in THREAD_READY state, that is,
+   processes that are ready to run but not actually running.
+   ready_queues[P] holds the ready threads of priority P in FIFO
+   order.  Bit P of ready_mask is set if and only if
+   ready_queues[P] is nonempty, so the highest-priority ready
+   thread is found with one bit scan and one list pop. */
+static struct list ready_queues[PRI_MAX + 1];
+static uint64_t ready_mask;
+static int ready_cnt;           /* # of threads in the ready queues. */
+
+/* List of all processes.  Processes are added to this list
+   when they are created and removed when they exit.
+   Used by the MLFQS to recompute every priority once a second. */
+static struct list all_list;
+static size_t thread_cnt;       /* # of threads in all_list. */
 
 /* Idle thread. */
 static struct thread *idle_thread;
@@ -44,6 +62,17 @@ static struct thread *initial_thread;
 /* Lock used by allocate_tid(). */
 static struct lock tid_lock;
 
+/* Pages of dead threads, kept for reuse by thread_create() so
+   that spawning a thread need not go through the page allocator
+   and zero a whole page.  Only the struct thread and the initial
+   stack frames of a recycled page are reinitialized; the rest of
+   the stack holds whatever the dead thread left there.  Access
+   with interrupts off, since schedule_tail() adds to it. */
+#define THREAD_CACHE_MAX 16
+static struct thread *thread_cache[THREAD_CACHE_MAX];
+static size_t thread_cache_cnt;
+static long long thread_cache_hits;  /* # of pages reused. */
+
 /* Stack frame for kernel_thread(). */
 struct kernel_thread_frame
   {
@@ -57,15 +86,44 @@ static long long idle_ticks;    /* # of timer ticks spent idle. */
 static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
 static long long user_ticks;    /* # of timer ticks in user programs. */
 
+/* Scheduler latency: histogram of the TSC cycles between a
+   thread becoming ready and starting to run, where bucket N
+   counts latencies in [2**N, 2**(N+1)). */
+#define LATENCY_BUCKETS 64
+static long long latency_hist[LATENCY_BUCKETS];
+static long long voluntary_cnt;    /* # of switches while blocking. */
+static long long involuntary_cnt;  /* # of switches while runnable. */
+
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
 static unsigned thread_ticks;   /* # of timer ticks since last yield. */
 
+/* MLFQS system load average, an exponentially weighted moving
+   average of the number of threads ready to run. */
+static fixed_t load_avg;
+
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* If true, use the stride scheduler.
+   Controlled by kernel command-line option "-stride". */
+bool thread_stride;
+
+/* Stride scheduler.  Ready threads are kept in a binary min-heap
+   ordered by pass, so the thread that is furthest behind its
+   share runs next.  A running thread's pass advances by its
+   stride, which is inversely proportional to its tickets, at
+   each timer tick.  The heap lives in pages that thread_create()
+   grows to hold every thread, so that pushing a thread never
+   needs to allocate memory. */
+#define STRIDE1 (1 << 20)       /* Stride of a thread with 1 ticket. */
+static struct thread **stride_heap;
+static size_t stride_heap_cnt;  /* # of threads in heap. */
+static size_t stride_heap_cap;  /* # of threads heap can hold. */
+static int64_t stride_vtime;    /* Pass of the last thread chosen. */
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
@@ -77,6 +135,18 @@ static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static int log2_floor (uint64_t);
+static struct thread *thread_page_get (void);
+static void thread_page_put (struct thread *);
+static void ready_queue_push (struct thread *);
+static void ready_queue_remove (struct thread *);
+static int ready_queue_max_priority (void);
+static bool stride_heap_reserve (size_t cnt);
+static void stride_heap_push (struct thread *);
+static struct thread *stride_heap_pop (void);
+static bool pass_less (const struct thread *, const struct thread *);
+static void mlfqs_tick (struct thread *);
+static int mlfqs_priority (const struct thread *);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -97,11 +167,18 @@ static tid_t allocate_tid (void);
 void
 thread_init (void)
 {
+  int i;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
-  sema_init (&file_sema, 1);
+  for (i = PRI_MIN; i <= PRI_MAX; i++)
+    list_init (&ready_queues[i]);
+  ready_mask = 0;
+  ready_cnt = 0;
+  list_init (&all_list);
+  load_avg = 0;
+  lock_init (&file_lock);
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
@@ -135,6 +212,8 @@ thread_tick (void)
   struct thread *t = thread_current ();
 
   /* Update statistics. */
+  trace (TRACE_TICK, t->tid, t->priority);
+  t->run_ticks++;
   if (t == idle_thread)
     idle_ticks++;
 #ifdef USERPROG
@@ -144,17 +223,73 @@ thread_tick (void)
   else
     kernel_ticks++;
 
+  if (thread_mlfqs)
+    mlfqs_tick (t);
+  else if (thread_stride && t != idle_thread)
+    t->pass += t->stride;
+
   /* Enforce preemption. */
   if (++thread_ticks >= TIME_SLICE)
     intr_yield_on_return ();
 }
 
-/* Prints thread statistics. */
+/* Charges CNT timer ticks that passed without a timer interrupt,
+   while the idle thread halted, to the idle thread. */
+void
+thread_add_idle_ticks (int cnt)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  idle_ticks += cnt;
+  idle_thread->run_ticks += cnt;
+}
+
+/* Stores the running thread's CPU usage into *USAGE. */
+void
+thread_get_usage (struct usage *usage)
+{
+  struct thread *t = thread_current ();
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  usage->run_ticks = t->run_ticks;
+  usage->run_cycles = t->run_cycles + (rdtsc () - t->switch_tsc);
+  usage->voluntary_switches = t->voluntary_switches;
+  usage->involuntary_switches = t->involuntary_switches;
+  intr_set_level (old_level);
+}
+
+/* Prints thread statistics, including the share of ticks the
+   CPU spent idle. */
 void
 thread_print_stats (void)
 {
+  long long total_ticks = idle_ticks + kernel_ticks + user_ticks;
+  struct list_elem *e;
+  int i;
+
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
           idle_ticks, kernel_ticks, user_ticks);
+  if (total_ticks > 0)
+    printf ("Thread: idle for %lld.%lld%% of ticks\n",
+            idle_ticks * 100 / total_ticks,
+            idle_ticks * 1000 / total_ticks % 10);
+  printf ("Thread: %lld voluntary switches, %lld involuntary switches\n",
+          voluntary_cnt, involuntary_cnt);
+  printf ("Thread: %lld thread pages recycled\n", thread_cache_hits);
+  for (e = list_begin (&all_list); e != list_end (&all_list);
+       e = list_next (e))
+    {
+      struct thread *t = list_entry (e, struct thread, allelem);
+      printf ("Thread: \"%s\" ran %lld ticks (%"PRIu64" cycles), "
+              "%u voluntary and %u involuntary switches\n",
+              t->name, t->run_ticks, t->run_cycles,
+              t->voluntary_switches, t->involuntary_switches);
+    }
+  for (i = 0; i < LATENCY_BUCKETS; i++)
+    if (latency_hist[i] > 0)
+      printf ("Thread: %lld wakeups with latency of 2^%d cycles\n",
+              latency_hist[i], i);
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -169,9 +304,8 @@ thread_print_stats (void)
    scheduled.  Use a semaphore or some other form of
    synchronization if you need to ensure ordering.
 
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   If PRIORITY is higher than the running thread's priority, the
+   new thread preempts the caller before this function returns. */
 tid_t
 thread_create (const char *name, int priority,
                thread_func *function, void *aux)
@@ -185,8 +319,13 @@ thread_create (const char *name, int priority,
 
   ASSERT (function != NULL);
 
+  /* Make room for the new thread in the stride scheduler's
+     ready heap. */
+  if (thread_stride && !stride_heap_reserve (thread_cnt + 1))
+    return TID_ERROR;
+
   /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  t = thread_page_get ();
   if (t == NULL)
     return TID_ERROR;
 
@@ -226,6 +365,7 @@ thread_block (void)
   ASSERT (!intr_context ());
   ASSERT (intr_get_level () == INTR_OFF);
 
+  trace (TRACE_BLOCK, thread_tid (), thread_get_priority ());
   thread_current ()->status = THREAD_BLOCKED;
   schedule ();
 }
@@ -234,10 +374,14 @@ thread_block (void)
    This is an error if T is not blocked.  (Use thread_yield() to
    make the running thread ready.)
 
-   This function does not preempt the running thread.  This can
-   be important: if the caller had disabled interrupts itself,
-   it may expect that it can atomically unblock a thread and
-   update other data. */
+   If T has a higher priority than the running thread, the
+   running thread is preempted, but only if the caller had
+   interrupts enabled (or from the end of the interrupt, if
+   called from an interrupt handler).  This can be important: if
+   the caller had disabled interrupts itself, it may expect that
+   it can atomically unblock a thread and update other data.
+   Such callers should invoke thread_preempt() once they are
+   done. */
 void
 thread_unblock (struct thread *t)
 {
@@ -247,9 +391,13 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
+  ready_queue_push (t);
   t->status = THREAD_READY;
+  t->switch_tsc = rdtsc ();
+  trace (TRACE_UNBLOCK, t->tid, t->priority);
   intr_set_level (old_level);
+
+  thread_preempt ();
 }
 
 /* Returns the name of the running thread. */
@@ -295,10 +443,13 @@ thread_exit (void)
 #ifdef USERPROG
   process_exit ();
 #endif
+  malloc_thread_exit ();
 
   /* Just set our status to dying and schedule another process.
      We will be destroyed during the call to schedule_tail(). */
   intr_disable ();
+  list_remove (&thread_current ()->allelem);
+  thread_cnt--;
   thread_current ()->status = THREAD_DYING;
   schedule ();
   NOT_REACHED ();
@@ -316,17 +467,92 @@ thread_yield (void)
 
   old_level = intr_disable ();
   if (curr != idle_thread)
-    list_push_back (&ready_list, &curr->elem);
+    ready_queue_push (curr);
   curr->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Yields the CPU if some ready thread has a higher priority than
+   the running thread.  (The stride scheduler ignores priorities,
+   so under it this does nothing: a thread that becomes ready
+   waits for the running thread's time slice to end.)  Within an
+   interrupt handler, the yield is deferred until the handler
+   returns.  Does nothing if interrupts are disabled, since the
+   caller then expects to run atomically. */
+void
+thread_preempt (void)
+{
+  enum intr_level old_level;
+  bool yield = false;
+
+  old_level = intr_disable ();
+  if (!thread_stride
+      && ready_queue_max_priority () > running_thread ()->priority)
+    {
+      if (intr_context ())
+        intr_yield_on_return ();
+      else
+        yield = old_level == INTR_ON;
+    }
+  intr_set_level (old_level);
+
+  if (yield)
+    thread_yield ();
+}
+
+/* Sets the current thread's base priority to NEW_PRIORITY.  The
+   thread keeps running at any higher priority donated to it
+   until it releases the locks involved.  Yields if the running
+   thread no longer has the highest priority.  Ignored under the
+   MLFQS, which computes priorities itself. */
 void
 thread_set_priority (int new_priority)
 {
-  thread_current ()->priority = new_priority;
+  struct thread *t = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (PRI_MIN <= new_priority && new_priority <= PRI_MAX);
+
+  if (thread_mlfqs)
+    return;
+
+  old_level = intr_disable ();
+  t->base_priority = new_priority;
+  thread_refresh_priority (t);
+  intr_set_level (old_level);
+
+  thread_preempt ();
+}
+
+/* Recomputes T's priority as the maximum of its base priority
+   and the priorities donated by the waiters on each lock that T
+   holds.  Each lock's waiters are kept in descending priority
+   order, so only the front waiter of each lock is examined.
+   Must be called with interrupts off. */
+void
+thread_refresh_priority (struct thread *t)
+{
+  int priority = t->base_priority;
+  struct list_elem *e;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (e = list_begin (&t->locks); e != list_end (&t->locks);
+       e = list_next (e))
+    {
+      struct lock *lock = list_entry (e, struct lock, elem);
+      struct list *waiters = &lock->semaphore.waiters;
+
+      if (!list_empty (waiters))
+        {
+          struct thread *donor = list_entry (list_front (waiters),
+                                             struct thread, elem);
+          if (donor->priority > priority)
+            priority = donor->priority;
+        }
+    }
+  thread_change_priority (t, priority);
 }
 
 /* Returns the current thread's priority. */
@@ -336,46 +562,149 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE and recomputes
+   its priority, yielding if it no longer has the highest
+   priority. */
 void
-thread_set_nice (int nice UNUSED)
+thread_set_nice (int nice)
 {
-  /* Not yet implemented. */
+  struct thread *t = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+  old_level = intr_disable ();
+  t->nice = nice;
+  if (thread_mlfqs)
+    t->priority = mlfqs_priority (t);
+  intr_set_level (old_level);
+
+  thread_preempt ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
+}
+
+/* Sets the current thread's tickets to TICKETS, which sets its
+   share of the CPU under the stride scheduler.  The new share
+   takes effect from the next timer tick. */
+void
+thread_set_tickets (int tickets)
+{
+  struct thread *t = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (TICKETS_MIN <= tickets && tickets <= TICKETS_MAX);
+
+  old_level = intr_disable ();
+  t->tickets = tickets;
+  t->stride = STRIDE1 / tickets;
+  intr_set_level (old_level);
+}
+
+/* Returns the current thread's tickets. */
+int
+thread_get_tickets (void)
+{
+  return thread_current ()->tickets;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int load_avg_100 = fp_round (load_avg * 100);
+  intr_set_level (old_level);
+
+  return load_avg_100;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int recent_cpu_100 = fp_round (thread_current ()->recent_cpu * 100);
+  intr_set_level (old_level);
+
+  return recent_cpu_100;
+}
+
+/* Does the MLFQS bookkeeping for a timer tick in which T was
+   running.  Only T's recent_cpu changes on most ticks, so only
+   T's priority is recomputed, every TIME_SLICE ticks; once a
+   second, load_avg and every thread's recent_cpu and priority
+   are recomputed. */
+static void
+mlfqs_tick (struct thread *t)
+{
+  int64_t ticks = timer_ticks ();
+
+  ASSERT (intr_context ());
+
+  if (t != idle_thread)
+    t->recent_cpu = fp_add_int (t->recent_cpu, 1);
+
+  if (ticks % TIMER_FREQ == 0)
+    {
+      int ready_threads = ready_cnt + (t != idle_thread);
+      fixed_t decay;
+      struct list_elem *e;
+
+      /* load_avg = (59/60) * load_avg + (1/60) * ready_threads. */
+      load_avg = (59 * load_avg + fp_from_int (ready_threads)) / 60;
+
+      /* recent_cpu = (2*load_avg)/(2*load_avg + 1) * recent_cpu
+                      + nice.
+         The decay factor is the same for every thread, so
+         compute it just once. */
+      decay = fp_div (2 * load_avg, fp_add_int (2 * load_avg, 1));
+      for (e = list_begin (&all_list); e != list_end (&all_list);
+           e = list_next (e))
+        {
+          struct thread *u = list_entry (e, struct thread, allelem);
+          if (u == idle_thread)
+            continue;
+          u->recent_cpu = fp_add_int (fp_mul (decay, u->recent_cpu), u->nice);
+          thread_change_priority (u, mlfqs_priority (u));
+        }
+    }
+  else if (ticks % TIME_SLICE == 0 && t != idle_thread)
+    t->priority = mlfqs_priority (t);
+
+  thread_preempt ();
+}
+
+/* Returns T's MLFQS priority,
+   PRI_MAX - (recent_cpu / 4) - (nice * 2),
+   clamped to the range PRI_MIN...PRI_MAX. */
+static int
+mlfqs_priority (const struct thread *t)
+{
+  int priority = PRI_MAX - fp_to_int (t->recent_cpu / 4) - t->nice * 2;
+
+  if (priority < PRI_MIN)
+    return PRI_MIN;
+  else if (priority > PRI_MAX)
+    return PRI_MAX;
+  else
+    return priority;
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
 
-   The idle thread is initially put on the ready list by
+   The idle thread is initially put on a ready queue by
    thread_start().  It will be scheduled once initially, at which
    point it initializes idle_thread, "up"s the semaphore passed
    to it to enable thread_start() to continue, and immediately
-   blocks.  After that, the idle thread never appears in the
-   ready list.  It is returned by next_thread_to_run() as a
-   special case when the ready list is empty. */
+   blocks.  After that, the idle thread never appears in a ready
+   queue.  It is returned by next_thread_to_run() as a special
+   case when all the ready queues are empty. */
 static void
 idle (void *idle_started_ UNUSED)
 {
@@ -400,7 +729,11 @@ idle (void *idle_started_ UNUSED)
          time.
 
          See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
-         7.11.1 "HLT Instruction". */
+         7.11.1 "HLT Instruction".
+
+         Before halting, let the timer skip the ticks in which
+         nothing is due. */
+      timer_idle_enter ();
       asm volatile ("sti; hlt" : : : "memory");
     }
 }
@@ -442,6 +775,9 @@ is_thread (struct thread *t)
 static void
 init_thread (struct thread *t, const char *name, int priority)
 {
+  struct thread *parent;
+  enum intr_level old_level;
+
   ASSERT (t != NULL);
   ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
   ASSERT (name != NULL);
@@ -450,14 +786,29 @@ init_thread (struct thread *t, const char *name, int priority)
   t->status = THREAD_BLOCKED;
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
-  t->priority = priority;
   t->magic = THREAD_MAGIC;
+  t->switch_tsc = rdtsc ();
+
+  /* A new thread inherits its creator's niceness and recent CPU
+     usage.  (The initial thread is its own creator, and has just
+     been zeroed.)  Under the MLFQS these determine its priority,
+     and PRIORITY is ignored. */
+  parent = running_thread ();
+  t->nice = parent->nice;
+  t->recent_cpu = parent->recent_cpu;
+  t->priority = thread_mlfqs ? mlfqs_priority (t) : priority;
+  t->base_priority = t->priority;
+  list_init (&t->locks);
+
+  /* Tickets are inherited too.  The pass starts at 0, which
+     ready_queue_push() moves up to the current virtual time. */
+  t->tickets = t != parent ? parent->tickets : TICKETS_DEFAULT;
+  t->stride = STRIDE1 / t->tickets;
 
-  int i;                    /* Init file descriptor. */
-  for(i = 0; i < 128; ++i)
-  {
-    t->f_d[i] = NULL;
-  }
+  old_level = intr_disable ();
+  list_push_back (&all_list, &t->allelem);
+  thread_cnt++;
+  intr_set_level (old_level);
 
   sema_init(&(t->load_lock), 0);
   sema_init(&(t->child_exit_lock), 0);
@@ -467,11 +818,14 @@ init_thread (struct thread *t, const char *name, int priority)
   t->success = false;
 
   list_init(&(t->child_list));
+  list_init(&t->mmap_list);
   list_push_back(&(running_thread()->child_list), &(t->child_elem));
 }
 
 /* Allocates a SIZE-byte frame at the top of thread T's stack and
-   returns a pointer to the frame's base. */
+   returns a pointer to the frame's base, which is zeroed.  (The
+   page may have been recycled from a dead thread, so it is not
+   necessarily zero already.) */
 static void *
 alloc_frame (struct thread *t, size_t size)
 {
@@ -480,21 +834,260 @@ alloc_frame (struct thread *t, size_t size)
   ASSERT (size % sizeof (uint32_t) == 0);
 
   t->stack -= size;
+  memset (t->stack, 0, size);
   return t->stack;
 }
 
+/* Returns a page for a new thread, taking a dead thread's page
+   from the cache if one is available and otherwise allocating a
+   fresh zeroed page.  Returns a null pointer if no page is
+   available.  init_thread() initializes the struct thread at
+   the base of the page either way. */
+static struct thread *
+thread_page_get (void)
+{
+  struct thread *t = NULL;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  if (thread_cache_cnt > 0)
+    {
+      t = thread_cache[--thread_cache_cnt];
+      thread_cache_hits++;
+    }
+  intr_set_level (old_level);
+
+  if (t == NULL)
+    t = palloc_get_page (PAL_ZERO);
+  return t;
+}
+
+/* Releases the page of dead thread T, keeping it in the cache
+   for thread_page_get() if there is room and otherwise freeing
+   it.  Must be called with interrupts off. */
+static void
+thread_page_put (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (thread_cache_cnt < THREAD_CACHE_MAX)
+    thread_cache[thread_cache_cnt++] = t;
+  else
+    palloc_free_page (t);
+}
+
+/* Adds T to the back of the ready queue for its priority. */
+static void
+ready_queue_push (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (PRI_MIN <= t->priority && t->priority <= PRI_MAX);
+
+  if (thread_stride)
+    {
+      /* A thread that was blocked does not bank the CPU time it
+         did not use while blocked. */
+      if (t->pass < stride_vtime)
+        t->pass = stride_vtime;
+      stride_heap_push (t);
+      ready_cnt++;
+      return;
+    }
+
+  list_push_back (&ready_queues[t->priority], &t->elem);
+  ready_mask |= (uint64_t) 1 << t->priority;
+  ready_cnt++;
+}
+
+/* Removes T from the ready queue for its priority. */
+static void
+ready_queue_remove (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->status == THREAD_READY);
+  ASSERT (!thread_stride);
+
+  list_remove (&t->elem);
+  if (list_empty (&ready_queues[t->priority]))
+    ready_mask &= ~((uint64_t) 1 << t->priority);
+  ready_cnt--;
+}
+
+/* Sets T's priority to PRIORITY.  If T is ready, moves it to the
+   back of the ready queue for its new priority (unless the stride
+   scheduler, which ignores priorities, is in use).  If T is
+   blocked on a semaphore, moves it to its new place among the
+   semaphore's waiters.  Does not preempt; callers should use
+   thread_preempt() afterward.  Must be called with interrupts
+   off. */
+void
+thread_change_priority (struct thread *t, int priority)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+  if (t->priority == priority)
+    return;
+  if (t->status == THREAD_READY && !thread_stride)
+    {
+      ready_queue_remove (t);
+      t->priority = priority;
+      ready_queue_push (t);
+    }
+  else
+    {
+      t->priority = priority;
+      if (t->status == THREAD_BLOCKED && t->wait_sema != NULL)
+        sema_requeue (t);
+    }
+}
+
+/* Returns the priority of the highest-priority ready thread, or
+   PRI_MIN - 1 if no thread is ready. */
+static int
+ready_queue_max_priority (void)
+{
+  uint32_t high = ready_mask >> 32;
+  uint32_t low = ready_mask;
+
+  /* __builtin_clz() compiles to a single BSR instruction, so
+     scan each 32-bit half rather than the 64-bit mask, which
+     would need a libgcc helper. */
+  if (high != 0)
+    return 63 - __builtin_clz (high);
+  else if (low != 0)
+    return 31 - __builtin_clz (low);
+  else
+    return PRI_MIN - 1;
+}
+
 /* Chooses and returns the next thread to be scheduled.  Should
-   return a thread from the run queue, unless the run queue is
-   empty.  (If the running thread can continue running, then it
-   will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+   return the first thread in the highest-priority nonempty ready
+   queue, unless every ready queue is empty.  (If the running
+   thread can continue running, then it will be in a ready
+   queue.)  If every ready queue is empty, return idle_thread. */
 static struct thread *
 next_thread_to_run (void)
 {
-  if (list_empty (&ready_list))
+  int priority = ready_queue_max_priority ();
+  struct thread *next;
+
+  if (thread_stride)
+    {
+      if (stride_heap_cnt == 0)
+        return idle_thread;
+      next = stride_heap_pop ();
+      stride_vtime = next->pass;
+      ready_cnt--;
+      return next;
+    }
+
+  if (priority < PRI_MIN)
     return idle_thread;
-  else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+
+  next = list_entry (list_front (&ready_queues[priority]),
+                     struct thread, elem);
+  ready_queue_remove (next);
+  return next;
+}
+
+/* Ensures that the stride scheduler's ready heap can hold CNT
+   threads, growing it if necessary.  Returns true if successful,
+   false if memory is exhausted.  Must not be called from an
+   interrupt context, since it may sleep. */
+static bool
+stride_heap_reserve (size_t cnt)
+{
+  size_t page_cnt = 1;
+  struct thread **heap;
+  enum intr_level old_level;
+
+  ASSERT (!intr_context ());
+
+  while (page_cnt * PGSIZE / sizeof *heap < cnt)
+    page_cnt *= 2;
+  if (cnt <= stride_heap_cap)
+    return true;
+  heap = palloc_get_multiple (0, page_cnt);
+  if (heap == NULL)
+    return false;
+
+  /* Another thread may have grown the heap while we slept. */
+  old_level = intr_disable ();
+  if (cnt > stride_heap_cap)
+    {
+      struct thread **old_heap = stride_heap;
+      size_t old_page_cnt = DIV_ROUND_UP (stride_heap_cap * sizeof *heap,
+                                          PGSIZE);
+
+      memcpy (heap, stride_heap, stride_heap_cnt * sizeof *heap);
+      stride_heap = heap;
+      stride_heap_cap = page_cnt * PGSIZE / sizeof *heap;
+      heap = old_heap;
+      page_cnt = old_page_cnt;
+    }
+  intr_set_level (old_level);
+
+  if (heap != NULL)
+    palloc_free_multiple (heap, page_cnt);
+  return true;
+}
+
+/* Adds T to the stride scheduler's ready heap. */
+static void
+stride_heap_push (struct thread *t)
+{
+  size_t i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (stride_heap_cnt < stride_heap_cap);
+
+  /* Sift up from the new leaf. */
+  for (i = stride_heap_cnt++; i > 0; i = (i - 1) / 2)
+    {
+      struct thread *parent = stride_heap[(i - 1) / 2];
+      if (!pass_less (t, parent))
+        break;
+      stride_heap[i] = parent;
+    }
+  stride_heap[i] = t;
+}
+
+/* Removes and returns the thread with the least pass from the
+   stride scheduler's ready heap, which must not be empty. */
+static struct thread *
+stride_heap_pop (void)
+{
+  struct thread *min, *last;
+  size_t i, child;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (stride_heap_cnt > 0);
+
+  min = stride_heap[0];
+  last = stride_heap[--stride_heap_cnt];
+
+  /* Sift the last leaf down from the root. */
+  for (i = 0; (child = 2 * i + 1) < stride_heap_cnt; i = child)
+    {
+      if (child + 1 < stride_heap_cnt
+          && pass_less (stride_heap[child + 1], stride_heap[child]))
+        child++;
+      if (!pass_less (stride_heap[child], last))
+        break;
+      stride_heap[i] = stride_heap[child];
+    }
+  stride_heap[i] = last;
+
+  return min;
+}
+
+/* Returns true if A should run before B under the stride
+   scheduler, that is, if A's pass is less than B's. */
+static bool
+pass_less (const struct thread *a, const struct thread *b)
+{
+  return a->pass < b->pass;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -517,11 +1110,18 @@ void
 schedule_tail (struct thread *prev)
 {
   struct thread *curr = running_thread ();
+  uint64_t now;
 
   ASSERT (intr_get_level () == INTR_OFF);
 
-  /* Mark us as running. */
+  /* Mark us as running, and record how long we waited to run
+     since becoming ready.  (The idle thread is never ready; it
+     runs only when no other thread is.) */
   curr->status = THREAD_RUNNING;
+  now = rdtsc ();
+  if (curr != idle_thread)
+    latency_hist[log2_floor (now - curr->switch_tsc)]++;
+  curr->switch_tsc = now;
 
   /* Start new time slice. */
   thread_ticks = 0;
@@ -532,14 +1132,14 @@ schedule_tail (struct thread *prev)
 #endif
 
   /* If the thread we switched from is dying, destroy its struct
-     thread.  This must happen late so that thread_exit() doesn't
-     pull out the rug under itself.  (We don't free
-     initial_thread because its memory was not obtained via
-     palloc().) */
+     thread, recycling its page for a later thread_create().  This
+     must happen late so that thread_exit() doesn't pull out the
+     rug under itself.  (We don't free initial_thread because its
+     memory was not obtained via palloc().) */
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread)
     {
       ASSERT (prev != curr);
-      palloc_free_page (prev);
+      thread_page_put (prev);
     }
 }
 
@@ -556,13 +1156,41 @@ schedule (void)
   struct thread *curr = running_thread ();
   struct thread *next = next_thread_to_run ();
   struct thread *prev = NULL;
+  uint64_t now;
 
   ASSERT (intr_get_level () == INTR_OFF);
   ASSERT (curr->status != THREAD_RUNNING);
   ASSERT (is_thread (next));
 
+  if (curr == idle_thread)
+    timer_idle_exit ();
+
+  /* Charge the time since CURR started running to it.  From
+     here, a ready CURR's switch_tsc marks when it became ready. */
+  now = rdtsc ();
+  curr->run_cycles += now - curr->switch_tsc;
+  curr->switch_tsc = now;
+
+  /* A thread that switches away while still ready was preempted
+     or yielded; one that blocks or dies gave up the CPU
+     voluntarily. */
+  if (curr != next && curr->status == THREAD_READY)
+    {
+      curr->involuntary_switches++;
+      involuntary_cnt++;
+    }
+  else if (curr != next)
+    {
+      curr->voluntary_switches++;
+      voluntary_cnt++;
+    }
+
   if (curr != next)
-    prev = switch_threads (curr, next);
+    {
+      trace (TRACE_SWITCH_OUT, curr->tid, curr->priority);
+      trace (TRACE_SWITCH_IN, next->tid, next->priority);
+      prev = switch_threads (curr, next);
+    }
   schedule_tail (prev);
 }
 
@@ -580,6 +1208,22 @@ allocate_tid (void)
   return tid;
 }
 
+/* Returns the base-2 logarithm of X, rounded down, or 0 if X is
+   0. */
+static int
+log2_floor (uint64_t x)
+{
+  uint32_t high = x >> 32;
+  uint32_t low = x;
+
+  if (high != 0)
+    return 63 - __builtin_clz (high);
+  else if (low != 0)
+    return 31 - __builtin_clz (low);
+  else
+    return 0;
+}
+
 /* Offset of `stack' member within `struct thread'.
    Used by switch.S, which can't figure it out on its own. */
 uint32_t thread_stack_ofs = offsetof (struct thread, stack);
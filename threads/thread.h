@@ -5,9 +5,11 @@
 #include <list.h>
 #include <hash.h>
 #include <stdint.h>
-#include "synch.h"   //semaphore
+#include <usage.h>
+#include "synch.h"   //lock
+#include "threads/fixed-point.h"
 
-extern struct semaphore file_sema;
+extern struct lock file_lock;
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -29,6 +31,17 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Thread niceness, for the multi-level feedback queue scheduler. */
+#define NICE_MIN -20                    /* Nicest to other threads. */
+#define NICE_DEFAULT 0                  /* Default niceness. */
+#define NICE_MAX 20                     /* Least nice. */
+
+/* Thread tickets, for the stride scheduler.  A thread's share of
+   the CPU is proportional to its tickets. */
+#define TICKETS_MIN 1                   /* Fewest tickets. */
+#define TICKETS_DEFAULT 100             /* Default tickets. */
+#define TICKETS_MAX 10000               /* Most tickets. */
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -80,10 +93,10 @@ typedef int tid_t;
    set to THREAD_MAGIC.  Stack overflow will normally change this
    value, triggering the assertion. */
 /* The `elem' member has a dual purpose.  It can be an element in
-   the run queue (thread.c), or it can be an element in a
+   a run queue (thread.c), or it can be an element in a
    semaphore wait list (synch.c).  It can be used these two ways
    only because they are mutually exclusive: only a thread in the
-   ready state is on the run queue, whereas only a thread in the
+   ready state is on a run queue, whereas only a thread in the
    blocked state is on a semaphore wait list. */
 struct thread
   {
@@ -92,7 +105,36 @@ struct thread
     enum thread_status status;          /* Thread state. */
     char name[16];                      /* Name (for debugging purposes). */
     uint8_t *stack;                     /* Saved stack pointer. */
-    int priority;                       /* Priority. */
+    int priority;                       /* Priority, including donations. */
+    struct list_elem allelem;           /* List element for all threads list. */
+
+    /* Shared between thread.c and synch.c, for priority donation. */
+    int base_priority;                  /* Priority before donations. */
+    struct list locks;                  /* Locks held, which may donate. */
+    struct lock *wait_lock;             /* Lock being waited for, if any. */
+    struct semaphore *wait_sema;        /* Semaphore being waited on. */
+
+    /* Owned by devices/timer.c. */
+    int64_t wakeup_tick;                /* When to wake from timer_sleep(). */
+
+    /* Owned by threads/malloc.c. */
+    struct magazine *magazines;         /* Per-descriptor free blocks. */
+
+    /* Owned by thread.c, used only by the MLFQS. */
+    int nice;                           /* Niceness. */
+    fixed_t recent_cpu;                 /* Recent CPU time received. */
+
+    /* Owned by thread.c, used only by the stride scheduler. */
+    int tickets;                        /* Share of the CPU. */
+    int64_t stride;                     /* Pass added per tick run. */
+    int64_t pass;                       /* Virtual time; least runs next. */
+
+    /* Owned by thread.c, for CPU accounting. */
+    int64_t run_ticks;                  /* Timer ticks spent running. */
+    uint64_t run_cycles;                /* TSC cycles spent running. */
+    uint64_t switch_tsc;                /* TSC when last made ready or run. */
+    unsigned voluntary_switches;        /* Switches while blocking. */
+    unsigned involuntary_switches;      /* Switches while still runnable. */
 
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
@@ -110,7 +152,7 @@ struct thread
     struct list child_list;             /* List of children. */
     struct list_elem child_elem;        /* children list element. */
     int exit_status;
-    struct file* f_d[128];               /* File descriptor. */
+    struct fd_table *fd_table;          /* Open files, or NULL if none yet. */
 
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
@@ -126,10 +168,17 @@ struct thread
    Controlled by kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
 
+/* If true, use the stride scheduler, which ignores priorities
+   and shares the CPU among threads in proportion to their
+   tickets.  Controlled by kernel command-line option "-stride". */
+extern bool thread_stride;
+
 void thread_init (void);
 void thread_start (void);
 
 void thread_tick (void);
+void thread_add_idle_ticks (int);
+void thread_get_usage (struct usage *);
 void thread_print_stats (void);
 
 typedef void thread_func (void *aux);
@@ -144,13 +193,19 @@ const char *thread_name (void);
 
 void thread_exit (void) NO_RETURN;
 void thread_yield (void);
+void thread_preempt (void);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
+void thread_change_priority (struct thread *, int);
+void thread_refresh_priority (struct thread *);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
 int thread_get_recent_cpu (void);
 int thread_get_load_avg (void);
 
+int thread_get_tickets (void);
+void thread_set_tickets (int);
+
 #endif /* threads/thread.h */
@@ -0,0 +1,234 @@
+#include "threads/trace.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/tsc.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
+#ifdef FILESYS
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#else
+#include "devices/disk.h"
+#endif
+
+/* Ring buffer size, in events.  Must be a power of 2. */
+#define TRACE_PAGES 16
+#define TRACE_CNT (TRACE_PAGES * PGSIZE / sizeof (struct trace_event))
+
+/* True while events are being recorded. */
+bool trace_enabled;
+
+static struct trace_event *events;      /* Ring buffer. */
+static uint32_t event_cnt;              /* # of events ever recorded. */
+
+/* Time-stamp counter and timer ticks when tracing started, to
+   estimate the time-stamp counter's frequency. */
+static uint64_t start_tsc;
+static int64_t start_ticks;
+static uint64_t tsc_hz;                 /* Estimate, set by trace_stop(). */
+
+static void trace_stop (void);
+static size_t trace_size (void);
+static void trace_read (void *buffer, size_t ofs, size_t size);
+
+/* Allocates the ring buffer and starts recording events.  If
+   memory cannot be allocated, tracing stays disabled. */
+void
+trace_init (void)
+{
+  events = palloc_get_multiple (0, TRACE_PAGES);
+  if (events == NULL)
+    {
+      printf ("trace: out of memory, tracing disabled\n");
+      return;
+    }
+  start_tsc = rdtsc ();
+  start_ticks = timer_ticks ();
+  trace_enabled = true;
+}
+
+/* Records an event of the given TYPE for the thread with the
+   given TID and PRIORITY, overwriting the oldest event if the
+   buffer is full.  Interrupts must be off, which on our single
+   CPU is all the synchronization the buffer needs.  Use the
+   trace() macro, which skips the call, and the evaluation of its
+   arguments, when tracing is disabled. */
+void
+trace_record (enum trace_type type, int tid, int priority)
+{
+  struct trace_event *e;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  e = &events[event_cnt++ % TRACE_CNT];
+  e->tsc = rdtsc ();
+  e->tid = tid;
+  e->type = type;
+  e->priority = priority;
+  e->reserved = 0;
+}
+
+/* Stops recording events and estimates the time-stamp counter's
+   frequency over the time tracing was enabled. */
+static void
+trace_stop (void)
+{
+  enum intr_level old_level;
+  int64_t ticks;
+
+  old_level = intr_disable ();
+  if (trace_enabled)
+    {
+      trace_enabled = false;
+      ticks = timer_elapsed (start_ticks);
+      if (ticks > 0)
+        tsc_hz = (rdtsc () - start_tsc) * TIMER_FREQ / ticks;
+    }
+  intr_set_level (old_level);
+}
+
+/* Returns the size in bytes of the trace dump, a struct
+   trace_header followed by the buffered events. */
+static size_t
+trace_size (void)
+{
+  size_t cnt = event_cnt < TRACE_CNT ? event_cnt : TRACE_CNT;
+  return sizeof (struct trace_header) + cnt * sizeof (struct trace_event);
+}
+
+/* Copies SIZE bytes starting at offset OFS in the trace dump
+   into BUFFER.  Tracing must be stopped. */
+static void
+trace_read (void *buffer_, size_t ofs, size_t size)
+{
+  uint8_t *buffer = buffer_;
+  struct trace_header h;
+  uint32_t first = event_cnt < TRACE_CNT ? 0 : event_cnt - TRACE_CNT;
+
+  ASSERT (!trace_enabled);
+  ASSERT (ofs + size <= trace_size ());
+
+  memcpy (h.magic, "PTRC", 4);
+  h.event_cnt = event_cnt - first;
+  h.lost_cnt = first;
+  h.reserved = 0;
+  h.tsc_hz = tsc_hz;
+
+  while (size > 0)
+    {
+      const uint8_t *src;
+      size_t chunk;
+
+      if (ofs < sizeof h)
+        {
+          src = (const uint8_t *) &h + ofs;
+          chunk = sizeof h - ofs;
+        }
+      else
+        {
+          /* Events in chronological order, oldest first, but
+             never across the end of the ring. */
+          size_t idx = (ofs - sizeof h) / sizeof (struct trace_event);
+          size_t slot = (first + idx) % TRACE_CNT;
+          size_t within = (ofs - sizeof h) % sizeof (struct trace_event);
+
+          src = (const uint8_t *) &events[slot] + within;
+          chunk = (TRACE_CNT - slot) * sizeof (struct trace_event) - within;
+        }
+      if (chunk > size)
+        chunk = size;
+      memcpy (buffer, src, chunk);
+      buffer += chunk;
+      ofs += chunk;
+      size -= chunk;
+    }
+}
+
+#ifdef FILESYS
+/* Stops tracing and writes the trace to FILE_NAME in the file
+   system, replacing any existing file, so that "get" can copy it
+   out. */
+void
+trace_save (const char *file_name)
+{
+  size_t size, ofs;
+  struct file *file;
+  void *buffer;
+
+  trace_stop ();
+  size = trace_size ();
+
+  printf ("Saving trace to '%s'...\n", file_name);
+  filesys_remove (file_name);
+  if (!filesys_create (file_name, size))
+    PANIC ("%s: create failed", file_name);
+  file = filesys_open (file_name);
+  if (file == NULL)
+    PANIC ("%s: open failed", file_name);
+
+  buffer = palloc_get_page (PAL_ASSERT);
+  for (ofs = 0; ofs < size; ofs += PGSIZE)
+    {
+      size_t chunk = size - ofs < PGSIZE ? size - ofs : PGSIZE;
+      trace_read (buffer, ofs, chunk);
+      if (file_write (file, buffer, chunk) != (off_t) chunk)
+        PANIC ("%s: write failed", file_name);
+    }
+  palloc_free_page (buffer);
+  file_close (file);
+}
+#else /* !FILESYS */
+/* The "get" action for kernels without a file system, which can
+   only get the trace, ARGV[1] being TRACE_FILE_NAME.  Stops
+   tracing and copies the trace to the scratch disk, hdc or
+   hd1:0, in the format that fsutil_get() uses, so that
+   "pintos -g" can read it: a sector holding "GET\0" and the size
+   in bytes as a 32-bit little-endian integer, followed by
+   sectors holding the data. */
+void
+trace_get (char **argv)
+{
+  const char *file_name = argv[1];
+  static uint8_t buffer[DISK_SECTOR_SIZE];
+  static bool gotten;
+  disk_sector_t sector = 0;
+  struct disk *dst;
+  size_t size, ofs;
+
+  if (strcmp (file_name, TRACE_FILE_NAME))
+    PANIC ("%s: only '%s' can be gotten without a file system",
+           file_name, TRACE_FILE_NAME);
+  if (gotten)
+    PANIC ("%s: can only be gotten once", file_name);
+  gotten = true;
+  trace_stop ();
+  size = trace_size ();
+
+  printf ("Getting '%s' from the trace buffer...\n", file_name);
+  disk_init ();
+  dst = disk_get (1, 0);
+  if (dst == NULL)
+    PANIC ("couldn't open target disk (hdc or hd1:0)");
+  if (DIV_ROUND_UP (size, DISK_SECTOR_SIZE) + 1 > disk_size (dst))
+    PANIC ("%s: out of space on scratch disk", file_name);
+
+  memset (buffer, 0, DISK_SECTOR_SIZE);
+  memcpy (buffer, "GET", 4);
+  ((int32_t *) buffer)[1] = size;
+  disk_write (dst, sector++, buffer);
+
+  for (ofs = 0; ofs < size; ofs += DISK_SECTOR_SIZE)
+    {
+      size_t chunk = size - ofs;
+      if (chunk > DISK_SECTOR_SIZE)
+        chunk = DISK_SECTOR_SIZE;
+      memset (buffer, 0, DISK_SECTOR_SIZE);
+      trace_read (buffer, ofs, chunk);
+      disk_write (dst, sector++, buffer);
+    }
+}
+#endif /* !FILESYS */
@@ -0,0 +1,73 @@
+#ifndef THREADS_TRACE_H
+#define THREADS_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Scheduler event tracing.
+
+   When enabled with the "-trace" kernel command-line option, the
+   scheduler records compact binary events into a fixed-size ring
+   buffer, overwriting the oldest events once it is full.
+   Recording an event takes only a few instructions and does no
+   I/O, so it hardly perturbs timing, unlike printf().
+
+   The "get trace" action, which "pintos -g trace" adds to the
+   kernel command line, copies the buffer out through the scratch
+   disk.  utils/trace2json converts the result into Chrome trace
+   JSON for viewing timelines. */
+
+/* Types of trace events. */
+enum trace_type
+  {
+    TRACE_SWITCH_IN,            /* Thread starts running. */
+    TRACE_SWITCH_OUT,           /* Thread stops running. */
+    TRACE_BLOCK,                /* Thread blocks. */
+    TRACE_UNBLOCK,              /* Thread becomes ready. */
+    TRACE_TICK                  /* Timer tick while thread runs. */
+  };
+
+/* A trace event, as stored in the ring buffer and in the dump. */
+struct trace_event
+  {
+    uint64_t tsc;               /* Time-stamp counter. */
+    int32_t tid;                /* Thread the event is about. */
+    uint8_t type;               /* A TRACE_* value. */
+    uint8_t priority;           /* Thread's priority at the time. */
+    uint16_t reserved;          /* Always 0. */
+  };
+
+/* Header at the beginning of a dumped trace, followed by
+   EVENT_CNT struct trace_events in chronological order. */
+struct trace_header
+  {
+    char magic[4];              /* "PTRC". */
+    uint32_t event_cnt;         /* # of events that follow. */
+    uint32_t lost_cnt;          /* # of older events overwritten. */
+    uint32_t reserved;          /* Always 0. */
+    uint64_t tsc_hz;            /* Time-stamp counter frequency. */
+  };
+
+/* Name of the pseudo-file that "get" copies the trace into. */
+#define TRACE_FILE_NAME "trace"
+
+extern bool trace_enabled;
+
+void trace_init (void);
+void trace_record (enum trace_type, int tid, int priority);
+void trace_save (const char *file_name);
+void trace_get (char **argv);
+
+/* Records an event of the given TYPE for the thread with the
+   given TID and PRIORITY, if tracing is enabled.  Must be called
+   with interrupts off.  A macro, so that TID and PRIORITY are not
+   even evaluated when tracing is disabled. */
+#define trace(TYPE, TID, PRIORITY)                              \
+        do                                                      \
+          {                                                     \
+            if (trace_enabled)                                  \
+              trace_record (TYPE, TID, PRIORITY);               \
+          }                                                     \
+        while (0)
+
+#endif /* threads/trace.h */
@@ -5,6 +5,7 @@
 #include "userprog/syscall.h" /* new */
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/tsc.h"
 #include "threads/vaddr.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
@@ -15,8 +16,16 @@
 /* Number of page faults processed. */
 static long long page_fault_cnt;
 
+/* Latency of page faults that brought in a page: bucket B counts
+   faults that took fewer than 2**B cycles. */
+#define FAULT_BUCKET_CNT 64
+static long long fault_buckets[FAULT_BUCKET_CNT];
+static long long fault_latency_cnt;
+
 static void kill(struct intr_frame *);
 static void page_fault(struct intr_frame *);
+static void record_fault_latency(uint64_t cycles);
+static int fault_percentile(int percent);
 
 /* Registers handlers for interrupts that can be caused by user
    programs.
@@ -70,6 +79,44 @@ void exception_init(void)
 void exception_print_stats(void)
 {
    printf("Exception: %lld page faults\n", page_fault_cnt);
+   if (fault_latency_cnt > 0)
+   {
+      printf("Page-in latency: p50 < 2^%d, p90 < 2^%d, p99 < 2^%d cycles\n",
+             fault_percentile(50), fault_percentile(90), fault_percentile(99));
+   }
+}
+
+/* Count a page fault that took CYCLES to bring in its page. */
+static void
+record_fault_latency(uint64_t cycles)
+{
+   int bucket = 0;
+
+   while (bucket < FAULT_BUCKET_CNT - 1 && cycles >= (uint64_t)1 << bucket)
+   {
+      bucket++;
+   }
+   fault_buckets[bucket]++;
+   fault_latency_cnt++;
+}
+
+/* Returns the bucket, that is, the base-2 log of the latency bound
+   in cycles, below which PERCENT percent of page-ins finished. */
+static int
+fault_percentile(int percent)
+{
+   long long seen = 0;
+   int bucket;
+
+   for (bucket = 0; bucket < FAULT_BUCKET_CNT - 1; bucket++)
+   {
+      seen += fault_buckets[bucket];
+      if (seen * 100 >= fault_latency_cnt * percent)
+      {
+         break;
+      }
+   }
+   return bucket;
 }
 
 /* Handler for an exception (probably) caused by a user process. */
@@ -131,6 +178,7 @@ page_fault(struct intr_frame *f)
    bool write;       /* True: access was write, false: access was read. */
    bool user;        /* True: access by user, false: access by kernel. */
    void *fault_addr; /* Fault address. */
+   uint64_t start = rdtsc();
 
    /* Obtain faulting address, the virtual address that was
      accessed to cause the fault.  It may point to code or to
@@ -181,15 +229,20 @@ page_fault(struct intr_frame *f)
       struct sup_page_table_entry *spte = find_spte(&thread_current()->page_table, fault_addr);
       if (spte)
       {
-         if (spte->type == 0) //FILE
+         frame_wait_evicted(spte); //its type may change until then
+         if (spte->type == PAGE_FILE || spte->type == PAGE_MMAP)
          {
             load = load_page_file(spte);
          }
-         else if (spte->type == 1) //SWAP
+         else if (spte->type == PAGE_SWAP)
          {
             load = swap_in(spte->user_vaddr);
          }
          spte->accessed_bit = false;
+         if (load) //only faults that brought a page in
+         {
+            record_fault_latency(rdtsc() - start);
+         }
          return;
       }
    }
@@ -198,6 +251,10 @@ page_fault(struct intr_frame *f)
       if ((f->esp - 32 <= fault_addr || stack_pointer < fault_addr) && (PHYS_BASE - MAX_STACK_SIZE <= fault_addr && fault_addr < PHYS_BASE))
       {
          success = stack_growth(fault_addr);
+         if (success)
+         {
+            record_fault_latency(rdtsc() - start);
+         }
          return;
       }
    }
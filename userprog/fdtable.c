@@ -0,0 +1,179 @@
+#include "userprog/fdtable.h"
+#include <bitmap.h>
+#include <debug.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Per-process file descriptor tables.
+
+   A process's table is allocated when it first opens a file, so
+   kernel threads and processes that never open files pay for
+   nothing but a pointer in struct thread.  It starts with room
+   for FD_INIT_CNT descriptors and doubles whenever it fills up.
+   A bitmap of descriptors in use lets open() find the lowest
+   free descriptor without looking at each slot in turn.
+
+   Only the owning thread touches its table, so no locking is
+   needed. */
+
+/* Descriptors below FD_FIRST are the console and are never
+   stored in the table. */
+#define FD_FIRST 3
+
+/* Initial number of descriptors in a table. */
+#define FD_INIT_CNT 16
+
+/* A file descriptor table. */
+struct fd_table
+  {
+    struct file **files;        /* Open files, indexed by fd. */
+    struct bitmap *used;        /* Descriptors in use. */
+    size_t cnt;                 /* Number of elements in FILES. */
+  };
+
+static struct fd_table *fd_table_create (void);
+static bool fd_table_grow (struct fd_table *);
+
+/* Adds FILE to the current process's descriptor table and
+   returns its descriptor, which is the lowest one not in use.
+   Returns -1 if memory could not be allocated. */
+int
+fd_table_add (struct file *file)
+{
+  struct thread *t = thread_current ();
+  size_t fd;
+
+  ASSERT (file != NULL);
+
+  if (t->fd_table == NULL)
+    {
+      t->fd_table = fd_table_create ();
+      if (t->fd_table == NULL)
+        return -1;
+    }
+
+  fd = bitmap_scan_and_flip (t->fd_table->used, FD_FIRST, 1, false);
+  if (fd == BITMAP_ERROR)
+    {
+      fd = t->fd_table->cnt;
+      if (!fd_table_grow (t->fd_table))
+        return -1;
+      bitmap_mark (t->fd_table->used, fd);
+    }
+  t->fd_table->files[fd] = file;
+  return fd;
+}
+
+/* Returns the file open as descriptor FD in the current process,
+   or a null pointer if FD is not open. */
+struct file *
+fd_table_get (int fd)
+{
+  struct fd_table *table = thread_current ()->fd_table;
+
+  if (table == NULL || fd < FD_FIRST || (size_t) fd >= table->cnt)
+    return NULL;
+  return table->files[fd];
+}
+
+/* Removes descriptor FD from the current process's table and
+   returns the file that was open as FD, which the caller must
+   close.  Returns a null pointer if FD is not open. */
+struct file *
+fd_table_remove (int fd)
+{
+  struct file *file = fd_table_get (fd);
+
+  if (file != NULL)
+    {
+      struct fd_table *table = thread_current ()->fd_table;
+      table->files[fd] = NULL;
+      bitmap_reset (table->used, fd);
+    }
+  return file;
+}
+
+/* Closes every file the current process has open and frees its
+   descriptor table.  A process killed in the middle of a file
+   system call still holds file_lock, so it is released first. */
+void
+fd_table_destroy (void)
+{
+  struct thread *t = thread_current ();
+  struct fd_table *table = t->fd_table;
+  size_t fd;
+
+  if (lock_held_by_current_thread (&file_lock))
+    lock_release (&file_lock);
+  if (table == NULL)
+    return;
+
+  lock_acquire (&file_lock);
+  for (fd = FD_FIRST; fd < table->cnt; fd++)
+    file_close (table->files[fd]);
+  lock_release (&file_lock);
+
+  t->fd_table = NULL;
+  bitmap_destroy (table->used);
+  free (table->files);
+  free (table);
+}
+
+/* Returns a new, empty descriptor table, or a null pointer if
+   memory could not be allocated. */
+static struct fd_table *
+fd_table_create (void)
+{
+  struct fd_table *table = malloc (sizeof *table);
+  if (table == NULL)
+    return NULL;
+
+  table->cnt = FD_INIT_CNT;
+  table->files = calloc (table->cnt, sizeof *table->files);
+  table->used = bitmap_create (table->cnt);
+  if (table->files == NULL || table->used == NULL)
+    {
+      free (table->files);
+      if (table->used != NULL)
+        bitmap_destroy (table->used);
+      free (table);
+      return NULL;
+    }
+  bitmap_set_multiple (table->used, 0, FD_FIRST, true);
+  return table;
+}
+
+/* Doubles the number of descriptors in TABLE.  Returns true if
+   successful, false if memory could not be allocated, in which
+   case TABLE is unchanged. */
+static bool
+fd_table_grow (struct fd_table *table)
+{
+  size_t new_cnt = table->cnt * 2;
+  struct file **files;
+  struct bitmap *used;
+  size_t i;
+
+  used = bitmap_create (new_cnt);
+  if (used == NULL)
+    return false;
+  files = realloc (table->files, new_cnt * sizeof *files);
+  if (files == NULL)
+    {
+      bitmap_destroy (used);
+      return false;
+    }
+
+  for (i = 0; i < table->cnt; i++)
+    bitmap_set (used, i, bitmap_test (table->used, i));
+  for (i = table->cnt; i < new_cnt; i++)
+    files[i] = NULL;
+  bitmap_destroy (table->used);
+
+  table->files = files;
+  table->used = used;
+  table->cnt = new_cnt;
+  return true;
+}
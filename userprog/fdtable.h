@@ -0,0 +1,11 @@
+#ifndef USERPROG_FDTABLE_H
+#define USERPROG_FDTABLE_H
+
+struct file;
+
+int fd_table_add (struct file *);
+struct file *fd_table_get (int fd);
+struct file *fd_table_remove (int fd);
+void fd_table_destroy (void);
+
+#endif /* userprog/fdtable.h */
@@ -0,0 +1,162 @@
+#include "userprog/futex.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Futexes ("fast user-space mutexes").
+
+   A futex is just an int in user memory.  User code manipulates
+   it with atomic instructions and calls into the kernel only to
+   sleep while it has an uninteresting value, or to wake threads
+   sleeping on it.  Sleepers wait in a queue keyed on the page
+   directory and user virtual address of the int, which is
+   created on the first wait and destroyed when it empties. */
+
+/* Threads waiting on one futex. */
+struct futex_queue
+  {
+    struct hash_elem hash_elem; /* Element in futex_table. */
+    uint32_t *pd;               /* Page directory of futex. */
+    const int *uaddr;           /* User virtual address of futex. */
+    struct list waiters;        /* List of struct futex_waiter. */
+  };
+
+/* A thread waiting on a futex. */
+struct futex_waiter
+  {
+    struct list_elem elem;      /* Element in futex_queue's waiters. */
+    struct semaphore sema;      /* Upped to wake the waiter. */
+  };
+
+/* Futex queues, and the lock that protects them.  A waiter
+   checks the futex's value and joins its queue under the lock,
+   and a waker changes the value before taking the lock, so no
+   wakeup can be lost in between. */
+static struct hash futex_table;
+static struct lock futex_lock;
+
+static hash_hash_func futex_hash;
+static hash_less_func futex_less;
+static struct futex_queue *futex_find (uint32_t *pd, const int *uaddr);
+
+/* Initializes the futex wait queues. */
+void
+futex_init (void)
+{
+  hash_init (&futex_table, futex_hash, futex_less, NULL);
+  lock_init (&futex_lock);
+}
+
+/* If the futex at UADDR in page directory PD holds EXPECTED,
+   sleeps until futex_wakeup() wakes us and returns 0.  Otherwise,
+   returns -1 immediately.  UADDR must be a valid, mapped user
+   address. */
+int
+futex_sleep (uint32_t *pd, const int *uaddr, int expected)
+{
+  struct futex_queue *q;
+  struct futex_waiter w;
+
+  lock_acquire (&futex_lock);
+  if (*uaddr != expected)
+    {
+      lock_release (&futex_lock);
+      return -1;
+    }
+
+  q = futex_find (pd, uaddr);
+  if (q == NULL)
+    {
+      q = malloc (sizeof *q);
+      if (q == NULL)
+        {
+          lock_release (&futex_lock);
+          return -1;
+        }
+      q->pd = pd;
+      q->uaddr = uaddr;
+      list_init (&q->waiters);
+      hash_insert (&futex_table, &q->hash_elem);
+    }
+  sema_init (&w.sema, 0);
+  list_push_back (&q->waiters, &w.elem);
+  lock_release (&futex_lock);
+
+  sema_down (&w.sema);
+  return 0;
+}
+
+/* Wakes up to N threads waiting on the futex at UADDR in page
+   directory PD, in the order they started waiting.  Returns the
+   number of threads woken. */
+int
+futex_wakeup (uint32_t *pd, const int *uaddr, int n)
+{
+  struct futex_queue *q;
+  int woken = 0;
+
+  lock_acquire (&futex_lock);
+  q = futex_find (pd, uaddr);
+  if (q != NULL)
+    {
+      while (woken < n && !list_empty (&q->waiters))
+        {
+          struct futex_waiter *w = list_entry (list_pop_front (&q->waiters),
+                                               struct futex_waiter, elem);
+          sema_up (&w->sema);
+          woken++;
+        }
+      if (list_empty (&q->waiters))
+        {
+          hash_delete (&futex_table, &q->hash_elem);
+          free (q);
+        }
+    }
+  lock_release (&futex_lock);
+
+  return woken;
+}
+
+/* Returns the queue for the futex at UADDR in page directory PD,
+   or a null pointer if no thread waits on it. */
+static struct futex_queue *
+futex_find (uint32_t *pd, const int *uaddr)
+{
+  struct futex_queue key;
+  struct hash_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&futex_lock));
+
+  key.pd = pd;
+  key.uaddr = uaddr;
+  e = hash_find (&futex_table, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct futex_queue, hash_elem) : NULL;
+}
+
+/* Returns a hash value for futex queue E. */
+static unsigned
+futex_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct futex_queue *q = hash_entry (e, struct futex_queue,
+                                            hash_elem);
+  const void *key[2] = {q->pd, q->uaddr};
+
+  return hash_bytes (key, sizeof key);
+}
+
+/* Returns true if futex queue A precedes futex queue B. */
+static bool
+futex_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct futex_queue *a = hash_entry (a_, struct futex_queue,
+                                            hash_elem);
+  const struct futex_queue *b = hash_entry (b_, struct futex_queue,
+                                            hash_elem);
+
+  if (a->pd != b->pd)
+    return a->pd < b->pd;
+  return a->uaddr < b->uaddr;
+}
@@ -0,0 +1,10 @@
+#ifndef USERPROG_FUTEX_H
+#define USERPROG_FUTEX_H
+
+#include <stdint.h>
+
+void futex_init (void);
+int futex_sleep (uint32_t *pd, const int *uaddr, int expected);
+int futex_wakeup (uint32_t *pd, const int *uaddr, int n);
+
+#endif /* userprog/futex.h */
@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "userprog/fdtable.h"
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
 #include "userprog/tss.h"
@@ -285,6 +286,16 @@ void process_exit(void)
   struct thread *curr = thread_current();
   uint32_t *pd;
 
+  /* Close any files still open, for a process killed by an
+     exception rather than exit(). */
+  fd_table_destroy();
+
+  /* Free the process's frames while its page directory still maps
+     them, before pagedir_destroy() frees the pages behind the
+     frame table's back. */
+  if (curr->pagedir != NULL)
+    destroy_spt(&curr->page_table);
+
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
   pd = curr->pagedir;
@@ -425,9 +436,9 @@ bool load(const char *file_name, void (**eip)(void), void **esp)
   process_activate();
 
   /* Open executable file. */
-  sema_down(&file_sema);
+  lock_acquire(&file_lock);
   file = filesys_open(file_name);
-  sema_up(&file_sema);
+  lock_release(&file_lock);
 
   if (file == NULL)
   {
@@ -436,9 +447,9 @@ bool load(const char *file_name, void (**eip)(void), void **esp)
   }
 
   /* Read and verify executable header. */
-  sema_down(&file_sema);
+  lock_acquire(&file_lock);
   off_t file_r = file_read(file, &ehdr, sizeof ehdr);
-  sema_up(&file_sema);
+  lock_release(&file_lock);
   if (file_r != sizeof ehdr || memcmp(ehdr.e_ident, "\177ELF\1\1\1", 7) || ehdr.e_type != 2 || ehdr.e_machine != 3 || ehdr.e_version != 1 || ehdr.e_phentsize != sizeof(struct Elf32_Phdr) || ehdr.e_phnum > 1024)
   {
     printf("load: %s: error loading executable\n", file_name);
@@ -451,20 +462,20 @@ bool load(const char *file_name, void (**eip)(void), void **esp)
   {
     struct Elf32_Phdr phdr;
 
-    sema_down(&file_sema);
+    lock_acquire(&file_lock);
     off_t file_len = file_length(file);
-    sema_up(&file_sema);
+    lock_release(&file_lock);
 
     if (file_ofs < 0 || file_ofs > file_len)
       goto done;
 
-    sema_down(&file_sema);
+    lock_acquire(&file_lock);
     file_seek(file, file_ofs);
-    sema_up(&file_sema);
+    lock_release(&file_lock);
 
-    sema_down(&file_sema);
+    lock_acquire(&file_lock);
     off_t file_r = file_read(file, &phdr, sizeof phdr);
-    sema_up(&file_sema);
+    lock_release(&file_lock);
 
     if (file_r != sizeof phdr)
       goto done;
@@ -527,9 +538,9 @@ done:
   /* We arrive here whether the load is successful or not. */
   if (file != NULL)
   {
-    // sema_down(&file_sema);
+    // lock_acquire(&file_lock);
     // file_close(file);  //pj2
-    // sema_up(&file_sema);
+    // lock_release(&file_lock);
   }
   // else
   // {
@@ -554,9 +565,9 @@ validate_segment(const struct Elf32_Phdr *phdr, struct file *file)
     return false;
 
   /* p_offset must point within FILE. */
-  sema_down(&file_sema);
+  lock_acquire(&file_lock);
   off_t file_len = file_length(file);
-  sema_up(&file_sema);
+  lock_release(&file_lock);
   if (phdr->p_offset > (Elf32_Off)file_len)
     return false;
 
@@ -614,9 +625,9 @@ load_segment(struct file *file, off_t ofs, uint8_t *upage,
   ASSERT(pg_ofs(upage) == 0);
   ASSERT(ofs % PGSIZE == 0);
 
-  sema_down(&file_sema);
+  lock_acquire(&file_lock);
   file_seek(file, ofs);
-  sema_up(&file_sema);
+  lock_release(&file_lock);
   while (read_bytes > 0 || zero_bytes > 0)
   {
     /* Do calculate how to fill this page.
@@ -634,9 +645,9 @@ load_segment(struct file *file, off_t ofs, uint8_t *upage,
 
     /* Load this page. */
     /*이제는 여기서 이거 하면 안돼안돼
-      sema_down(&file_sema);
+      lock_acquire(&file_lock);
       off_t file_r = file_read (file, kpage, page_read_bytes);
-      sema_up(&file_sema);
+      lock_release(&file_lock);
       if (file_r != (int) page_read_bytes)
         {
           palloc_free_page (kpage);
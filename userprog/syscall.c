@@ -4,8 +4,12 @@
 #include <user/syscall.h>
 #include <kernel/list.h>
 #include "threads/interrupt.h"
-#include "threads/thread.h" //->file_sema
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/thread.h" //->file_lock
 #include "threads/vaddr.h"
+#include "userprog/fdtable.h"
+#include "userprog/futex.h"
 #include "userprog/pagedir.h"
 #include "filesys/off_t.h" /* new */
 #include "vm/frame.h"
@@ -17,6 +21,7 @@ void userp_exit(int status);
 struct sup_page_table_entry *check_valid_spte(const void *vaddr, void *esp);
 void check_valid_uvaddr(const void *str, unsigned size, void *esp, bool is_buffer, bool write);
 void check_valid_pointer(const void *vaddr);
+static void check_valid_futex(const int *addr, void *esp);
 
 struct file
 {
@@ -86,6 +91,27 @@ check_valid_spte(const void *vaddr, void *esp)
   return spte;
 }
 
+/* A futex must be an aligned int in mapped user memory. */
+static void
+check_valid_futex(const int *addr, void *esp)
+{
+  unsigned i;
+
+  if ((uintptr_t)addr % sizeof *addr != 0)
+  {
+    userp_exit(-1);
+  }
+  check_valid_pointer(addr);
+  check_valid_spte(addr, esp);
+  for (i = 0; i < sizeof *addr; i++)
+  {
+    if (get_user((const uint8_t *)addr + i) == -1)
+    {
+      userp_exit(-1);
+    }
+  }
+}
+
 void check_valid_uvaddr(const void *str, unsigned size, void *esp, bool is_buffer, bool write)
 {
   if (is_buffer)
@@ -117,6 +143,7 @@ void check_valid_uvaddr(const void *str, unsigned size, void *esp, bool is_buffe
 void syscall_init(void)
 {
   intr_register_int(0x30, 3, INTR_ON, syscall_handler, "syscall");
+  futex_init();
 }
 
 static void
@@ -204,9 +231,9 @@ syscall_handler(struct intr_frame *f)
     check_valid_pointer(second);       //also a pointer
     check_valid_uvaddr((f->esp) + 4, NULL, f->esp, false, false);
 
-    sema_down(&file_sema);
+    lock_acquire(&file_lock);
     f->eax = filesys_create((const char *)first, (int32_t)(second));
-    sema_up(&file_sema);
+    lock_release(&file_lock);
     break;
   }
 
@@ -219,9 +246,9 @@ syscall_handler(struct intr_frame *f)
     }
     check_valid_pointer((f->esp) + 4); //file = first
     check_valid_uvaddr((f->esp) + 4, NULL, f->esp, false, false);
-    sema_down(&file_sema);
+    lock_acquire(&file_lock);
     f->eax = filesys_remove((const char *)first);
-    sema_up(&file_sema);
+    lock_release(&file_lock);
     break;
   }
 
@@ -242,9 +269,9 @@ syscall_handler(struct intr_frame *f)
     // }
 
     struct file *file = *(char **)(f->esp + 4);
-    sema_down(&file_sema);
+    lock_acquire(&file_lock);
     struct file *fp = filesys_open(*(char **)(f->esp + 4));
-    sema_up(&file_sema);
+    lock_release(&file_lock);
 
     if (fp == NULL) //file could not opened
     {
@@ -253,22 +280,19 @@ syscall_handler(struct intr_frame *f)
     else
     {
       f->eax = -1;
-      sema_down(&file_sema);
+      lock_acquire(&file_lock);
       if (strcmp(thread_current()->name, file) == 0)
       {
         file_deny_write(fp);
       }
-      sema_up(&file_sema);
+      lock_release(&file_lock);
 
-      for (i = 3; i < 128; ++i)
+      f->eax = fd_table_add(fp);
+      if ((int)f->eax == -1) //out of memory for the fd table
       {
-        if (thread_current()->f_d[i] == NULL)
-        {
-
-          thread_current()->f_d[i] = fp;
-          f->eax = i;
-          break; //end for loop
-        }
+        lock_acquire(&file_lock);
+        file_close(fp);
+        lock_release(&file_lock);
       }
     }
 
@@ -278,7 +302,7 @@ syscall_handler(struct intr_frame *f)
   //syscall1 (SYS_FILESIZE, fd);
   case SYS_FILESIZE: //7
   {
-    if (thread_current()->f_d[first] == NULL)
+    if (fd_table_get(first) == NULL)
     {
       userp_exit(-1);
     }
@@ -287,9 +311,9 @@ syscall_handler(struct intr_frame *f)
     //   exit(-1);
     // }
     check_valid_pointer((f->esp) + 4); //fd = first
-    sema_down(&file_sema);
-    f->eax = file_length(thread_current()->f_d[first]);
-    sema_up(&file_sema);
+    lock_acquire(&file_lock);
+    f->eax = file_length(fd_table_get(first));
+    lock_release(&file_lock);
     break;
   }
 
@@ -324,7 +348,7 @@ syscall_handler(struct intr_frame *f)
     }
     else if (first > 2) //not stdin
     {
-      if (thread_current()->f_d[first] == NULL)
+      if (fd_table_get(first) == NULL)
       {
         userp_exit(-1);
       }
@@ -332,9 +356,9 @@ syscall_handler(struct intr_frame *f)
       {
         userp_exit(-1);
       }
-      sema_down(&file_sema);
-      f->eax = file_read(thread_current()->f_d[first], second, third);
-      sema_up(&file_sema);
+      lock_acquire(&file_lock);
+      f->eax = file_read(fd_table_get(first), second, third);
+      lock_release(&file_lock);
       break; //end read
     }
     f->eax = i;
@@ -368,20 +392,21 @@ syscall_handler(struct intr_frame *f)
     }
     else if (fd > 2) //not stdout
     {
-      if (thread_current()->f_d[fd] == NULL)
+      struct file *fp = fd_table_get(fd);
+      if (fp == NULL)
       {
         userp_exit(-1);
       }
-      if (thread_current()->f_d[fd]->deny_write)
+      if (fp->deny_write)
       {
-        sema_down(&file_sema);
-        file_deny_write(thread_current()->f_d[fd]);
-        sema_up(&file_sema);
+        lock_acquire(&file_lock);
+        file_deny_write(fp);
+        lock_release(&file_lock);
       }
 
-      sema_down(&file_sema);
-      f->eax = file_write(thread_current()->f_d[fd], second, third);
-      sema_up(&file_sema);
+      lock_acquire(&file_lock);
+      f->eax = file_write(fp, second, third);
+      lock_release(&file_lock);
       break; //end write
     }
     f->eax = -1;
@@ -392,7 +417,7 @@ syscall_handler(struct intr_frame *f)
   case SYS_SEEK: //10
   {
     int fd = first;
-    if (thread_current()->f_d[fd] == NULL)
+    if (fd_table_get(fd) == NULL)
     {
       userp_exit(-1);
     }
@@ -400,9 +425,9 @@ syscall_handler(struct intr_frame *f)
     check_valid_pointer((f->esp) + 8); //buffer = second
     check_valid_pointer(second);       //also a pointer
 
-    sema_down(&file_sema);
-    file_seek(thread_current()->f_d[fd], (unsigned)second);
-    sema_up(&file_sema);
+    lock_acquire(&file_lock);
+    file_seek(fd_table_get(fd), (unsigned)second);
+    lock_release(&file_lock);
     break;
   }
 
@@ -410,15 +435,15 @@ syscall_handler(struct intr_frame *f)
   case SYS_TELL: //11
   {
     int fd = first;
-    if (thread_current()->f_d[fd] == NULL)
+    if (fd_table_get(fd) == NULL)
     {
       userp_exit(-1);
     }
     check_valid_pointer((f->esp) + 4); //fd = first
 
-    sema_down(&file_sema);
-    file_tell(thread_current()->f_d[fd]);
-    sema_up(&file_sema);
+    lock_acquire(&file_lock);
+    file_tell(fd_table_get(fd));
+    lock_release(&file_lock);
     break;
   }
 
@@ -426,18 +451,17 @@ syscall_handler(struct intr_frame *f)
   case SYS_CLOSE: //12
   {
     int fd = first;
-    if (thread_current()->f_d[fd] == NULL)
+    struct file *fp = fd_table_remove(fd); //file closed -> free its fd
+    if (fp == NULL)
     {
       userp_exit(-1);
     }
     check_valid_pointer((f->esp) + 4); //fd = first
 
-    sema_down(&file_sema);
-    file_allow_write(thread_current()->f_d[fd]);
-    file_close(thread_current()->f_d[fd]);
-    sema_up(&file_sema);
-
-    thread_current()->f_d[fd] = NULL; //file closed -> make it NULL
+    lock_acquire(&file_lock);
+    file_allow_write(fp);
+    file_close(fp);
+    lock_release(&file_lock);
     break;
   }
 
@@ -463,6 +487,96 @@ syscall_handler(struct intr_frame *f)
     break;
   }
 
+  /* Extensions */
+  //syscall1 (SYS_GETUSAGE, usage);
+  case SYS_GETUSAGE:
+  {
+    struct usage usage;
+    uint8_t *dst = (uint8_t *)first;
+
+    check_valid_pointer((f->esp) + 4); //usage = first
+    check_valid_pointer(dst);
+    check_valid_pointer(dst + sizeof usage - 1);
+    check_valid_uvaddr(dst, sizeof usage, f->esp, true, true);
+
+    thread_get_usage(&usage);
+    for (i = 0; i < (int)sizeof usage; i++)
+    {
+      if (!put_user(dst + i, ((uint8_t *)&usage)[i]))
+      {
+        userp_exit(-1);
+      }
+    }
+    f->eax = true;
+    break;
+  }
+
+  //syscall1 (SYS_SETTICKETS, tickets);
+  case SYS_SETTICKETS:
+  {
+    int tickets = first;
+    check_valid_pointer((f->esp) + 4); //tickets = first
+
+    if (tickets < TICKETS_MIN || tickets > TICKETS_MAX)
+    {
+      f->eax = false;
+      break;
+    }
+    thread_set_tickets(tickets);
+    f->eax = true;
+    break;
+  }
+
+  //syscall2 (SYS_FUTEX_WAIT, addr, expected);
+  case SYS_FUTEX_WAIT:
+  {
+    const int *addr = (const int *)first;
+    int expected = (int)second;
+    check_valid_pointer((f->esp) + 4); //addr = first
+    check_valid_pointer((f->esp) + 8); //expected = second
+    check_valid_futex(addr, f->esp);
+
+    f->eax = futex_sleep(thread_current()->pagedir, addr, expected);
+    break;
+  }
+
+  //syscall2 (SYS_FUTEX_WAKE, addr, n);
+  case SYS_FUTEX_WAKE:
+  {
+    const int *addr = (const int *)first;
+    int n = (int)second;
+    check_valid_pointer((f->esp) + 4); //addr = first
+    check_valid_pointer((f->esp) + 8); //n = second
+    check_valid_futex(addr, f->esp);
+
+    f->eax = futex_wakeup(thread_current()->pagedir, addr, n);
+    break;
+  }
+
+  //syscall1 (SYS_MEMSTAT, stats);
+  case SYS_MEMSTAT:
+  {
+    struct memstat stats;
+    uint8_t *dst = (uint8_t *)first;
+
+    check_valid_pointer((f->esp) + 4); //stats = first
+    check_valid_pointer(dst);
+    check_valid_pointer(dst + sizeof stats - 1);
+    check_valid_uvaddr(dst, sizeof stats, f->esp, true, true);
+
+    palloc_get_stats(&stats);
+    malloc_get_stats(&stats);
+    for (i = 0; i < (int)sizeof stats; i++)
+    {
+      if (!put_user(dst + i, ((uint8_t *)&stats)[i]))
+      {
+        userp_exit(-1);
+      }
+    }
+    f->eax = true;
+    break;
+  }
+
   } // End of switch(sys_num)
 } // End of syscall_handler()
 
@@ -470,7 +584,7 @@ syscall_handler(struct intr_frame *f)
 mapid_t mmap(int fd, void *addr)
 {
   /* Check validity of fd, addr. */
-  if (thread_current()->f_d[fd] == NULL || !is_user_vaddr(addr) || get_user(addr) == -1 || (int)addr == 0 //virtual page address 0 is not mapped in pintos
+  if (fd_table_get(fd) == NULL || !is_user_vaddr(addr) || get_user(addr) == -1 || (int)addr == 0 //virtual page address 0 is not mapped in pintos
       || ((int)addr % PGSIZE) != 0                                                                        //addr is not page-aligned
       || fd <= 1)
   {
@@ -478,16 +592,16 @@ mapid_t mmap(int fd, void *addr)
   }
 
   /* Open file fd. */
-  sema_down(&file_sema);
+  lock_acquire(&file_lock);
 
-  struct file *f = thread_current()->f_d[fd]; //assure not null
+  struct file *f = fd_table_get(fd); //assure not null
   struct file *f_copy = NULL;
 
   f_copy = file_reopen(f);
 
   if (!f_copy || !file_length(f_copy))
   {
-    sema_up(&file_sema);
+    lock_release(&file_lock);
     return MAP_FAILED;
   }
 
@@ -503,9 +617,10 @@ mapid_t mmap(int fd, void *addr)
   }
 
   /* Create and set up 'mmap_file'. */
-  struct mmap_file *mfile = (struct mmap_file *)malloc(sizeof(struct mmap_file));
+  struct mmap_file *mfile = kmem_cache_alloc(mmap_file_cache);
   mfile->mapid = mapid;
   mfile->file = f_copy;
+  list_init(&mfile->mmap_sptes);
   list_push_back(&thread_current()->mmap_list, &mfile->elem);
 
   /* Create and set up spte: Map each page of the file to the filesystem. */
@@ -519,13 +634,15 @@ mapid_t mmap(int fd, void *addr)
     size_t zero_bytes = PGSIZE - read_bytes;
 
     struct sup_page_table_entry *spte;
-    spte = (struct sup_page_table_entry*) malloc(sizeof(struct sup_page_table_entry));
+    spte = kmem_cache_alloc(spte_cache);
 
-    spte->user_vaddr = addr;
+    spte->user_vaddr = file_addr;
+    spte->type = PAGE_MMAP; //loaded from, and written back to, the file
     spte->dirty_bit = false;
     spte->accessed_bit = false; //FIXME: ???
     spte->writable = true;
-    spte->is_loaded = true; //FIXME: ???
+    spte->is_loaded = false; //loaded on first fault
+    spte->evicting = false;
     spte->file = f_copy;
     spte->offset = offset;
     spte->read_bytes = read_bytes;
@@ -535,12 +652,14 @@ mapid_t mmap(int fd, void *addr)
     e = hash_insert (&thread_current()->page_table, &spte->hash_elem);
     if(e) //mapping overlap
     {
-      sema_up(&file_sema);
+      kmem_cache_free(spte_cache, spte);
+      lock_release(&file_lock);
       return MAP_FAILED;
     }
+    list_push_back(&mfile->mmap_sptes, &spte->map_elem);
   }
 
-  sema_up(&file_sema);
+  lock_release(&file_lock);
   return mapid;
 }
 
@@ -571,37 +690,40 @@ void munmap(mapid_t mapping)
   }
 
   /* Delete sptes. */
-  sema_down(&file_sema);
+  lock_acquire(&file_lock);
   struct list_elem *le;
   struct sup_page_table_entry *spte = NULL;
-  for(le = list_begin(&mfile->mmap_sptes); le != list_end(&mfile->mmap_sptes); le = list_next(le))
+  for(le = list_begin(&mfile->mmap_sptes); le != list_end(&mfile->mmap_sptes); )
   {
     spte = list_entry(le, struct sup_page_table_entry, map_elem);
-    hash_delete(&thread_current()->page_table, &spte->hash_elem);
+    le = list_next(le);
+    void *kpage = frame_pin(spte); //keep the daemon off it
+    if (kpage != NULL) //write back if dirty, then give up the frame
+    {
+      if (spte->dirty_bit || pagedir_is_dirty(t->pagedir, spte->user_vaddr))
+      {
+        file_write_at(spte->file, kpage, spte->read_bytes, spte->offset);
+      }
+      pagedir_clear_page(t->pagedir, spte->user_vaddr);
+      frame_free(kpage);
+    }
+    hash_delete(&t->page_table, &spte->hash_elem);
+    kmem_cache_free(spte_cache, spte);
   }
   /* Delete mmap_file. */
   list_remove(&mfile->elem);
   file_close(mfile->file);
-  free(mfile);
+  kmem_cache_free(mmap_file_cache, mfile);
 
-  sema_up(&file_sema);
+  lock_release(&file_lock);
 }
 
 
 
 void userp_exit(int status) //userprog_exit
 {
-  int i;
   thread_current()->exit_status = status;
-  for (i = 3; i < 128; ++i)
-  {
-    if (thread_current()->f_d[i] != NULL) //close all files before die
-    {
-      sema_down(&file_sema);
-      file_close(thread_current()->f_d[i]);
-      sema_up(&file_sema);
-    }
-  }
+  fd_table_destroy(); //close all files before die
   printf("%s: exit(%d)\n", thread_name(), status);
   thread_exit();
 }
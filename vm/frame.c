@@ -1,11 +1,15 @@
 #include "vm/frame.h"
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
 
 #include "filesys/file.h"
+#include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "userprog/pagedir.h"
@@ -14,12 +18,104 @@
 #include "vm/page.h"
 #include "vm/swap.h"
 
+struct lock frame_table_lock;
+struct list frame_table_list;
+
+/* Frame table: one entry for each page in the user pool. */
+static struct frame_table_entry *frame_table;
+static size_t frame_cnt;
+
+/* Clock hand: the next frame in frame_table_list to consider for
+   eviction.  It keeps its place between evictions, so each scan
+   picks up where the last one stopped instead of always looking
+   at the same frames first. */
+static struct list_elem *clock_hand;
+
+/* The hand gives up after this many trips around the frames.  The
+   first trip clears every accessed bit, so the second one always
+   finds a victim. */
+#define CLOCK_REVOLUTIONS 2
+
+/* frame_evict() drops frame_table_lock while it writes a page out.
+   Signaled, with frame_table_lock, when it is done, and also when a
+   pinned frame is unpinned or freed, for allocate_frame() waiting
+   for a frame it can evict. */
+static struct condition evict_done;
+
+/* Pageout daemon.  It wakes when fewer than pageout_low_water user
+   frames are free and evicts pages until pageout_high_water are free,
+   so that most page faults find a free frame without waiting for
+   a victim to be written out.  Set from the kernel command line. */
+size_t pageout_low_water = 16;
+size_t pageout_high_water = 32;
+static struct semaphore pageout_sema; /* Upped to wake the daemon. */
+static bool pageout_started;          /* Is the daemon running? */
+static bool pageout_wanted;           /* Has it been woken, but not run? */
+
+/* Statistics. */
+static size_t frame_used_cnt;     /* Frames in frame_table_list. */
+static long long pageout_cnt;     /* Frames freed by the daemon. */
+static long long direct_evict_cnt; /* Evictions by a faulting process. */
+static long long evict_cnt;       /* Frames evicted. */
+static long long evict_drop_cnt;  /* ...whose clean file page was dropped. */
+static long long evict_file_cnt;  /* ...whose mmap page was written to its file. */
+static long long evict_swap_cnt;  /* ...whose page was written to swap. */
+static long long clock_step_cnt;  /* Frames looked at by the hand. */
+
+static void *frame_evict(void);
+static bool frame_any_pinned(void);
+static void pageout_wake(void);
+static thread_func pageout_daemon NO_RETURN;
+static struct frame_table_entry *clock_select(void);
+static bool frame_referenced(struct frame_table_entry *fte);
+static void clock_remove(struct frame_table_entry *fte);
+static uint32_t *kernel_alias_pd(void);
+
 /* Initialize frame table. */
 /* Given in skeleton. */
+/* Called after palloc_init(), which sizes the user pool. */
 void frame_init(void)
 {
+  size_t i;
+
   lock_init(&frame_table_lock);
   list_init(&frame_table_list);
+
+  frame_cnt = palloc_user_page_cnt();
+  frame_table = calloc(frame_cnt, sizeof *frame_table);
+  if (frame_table == NULL)
+    PANIC("out of memory for frame table");
+  for (i = 0; i < frame_cnt; i++)
+    frame_table[i].owner = NULL;
+  clock_hand = list_end(&frame_table_list);
+  cond_init(&evict_done);
+  sema_init(&pageout_sema, 0);
+}
+
+/* Start the pageout daemon, unless the low watermark is 0. */
+/* Called once the swap disk is ready. */
+void frame_start_pageout(void)
+{
+  if (pageout_low_water == 0)
+  {
+    return;
+  }
+  if (pageout_high_water < pageout_low_water)
+  {
+    pageout_high_water = pageout_low_water;
+  }
+  pageout_started = true;
+  thread_create("pageout", PRI_DEFAULT, pageout_daemon, NULL);
+}
+
+/* Returns the frame table entry for FRAME, a page from the user pool. */
+struct frame_table_entry *
+frame_lookup(void *frame)
+{
+  size_t idx = palloc_user_page_idx(frame);
+
+  ASSERT(idx < frame_cnt);
+  return &frame_table[idx];
 }
 
 /*pintos pdf */
@@ -30,59 +126,369 @@ void frame_init(void)
   but swap is full, panic the kernel.
   */
 
-/* Make a new frame table entry for addr. */
+/* Make a new frame table entry for spte's page. */
 /* Given in skeleton. */
 void * //-> 제대로 allocate 됐는지 리턴하라는 건가??
-allocate_frame(void *addr, enum palloc_flags flags)
+allocate_frame(struct sup_page_table_entry *spte, enum palloc_flags flags)
 {
 
   // return palloc_get_page(PAL_USER); //for debugging
 
-  lock_acquire(&frame_table_lock);
+  ASSERT(flags & PAL_USER);
 
   void *frame_page = palloc_get_page(flags); //from user pool
-  if (frame_page == NULL) /* If page allocation failed. */
+  bool evicted = false;
+
+  lock_acquire(&frame_table_lock);
+  while (frame_page == NULL) /* If page allocation failed. */
   {
-    frame_page = swap_out(flags);
-    lock_release(&frame_table_lock);
-    return NULL;
-  }
+    /* The daemon fell behind: take over a victim's frame. */
+    frame_page = frame_evict();
+    if (frame_page != NULL)
+    {
+      direct_evict_cnt++;
+      evicted = true;
+      if (flags & PAL_ZERO)
+      {
+        memset(frame_page, 0, PGSIZE);
+      }
+      break;
+    }
 
-  struct frame_table_entry *fte = malloc(sizeof(struct frame_table_entry));
-  if (fte == NULL)
+    /* Every frame in use is pinned.  Pins are only held while a
+       page is filled in, written out or torn down, so wait for one
+       to go away, unless there are none. */
+    if (!frame_any_pinned())
+    {
+      PANIC("no frame to evict");
+    }
+    cond_wait(&evict_done, &frame_table_lock);
+    frame_page = palloc_get_page(flags);
+  }
+  if (palloc_user_free_cnt() < pageout_low_water)
   {
-    /* If frame allocation failed. */
-    lock_release(&frame_table_lock);
-    return NULL;
+    pageout_wake();
   }
+
   /* Set frame table entry. */
-  fte->vaddr = addr;
+  struct frame_table_entry *fte = frame_lookup(frame_page);
+  ASSERT(fte->owner == NULL);
+  fte->vaddr = spte->user_vaddr;
   fte->frame = frame_page;
   fte->owner = thread_current();
-  // fte->spte //TODO: ?? 
+  fte->spte = spte;
+  fte->pinned = true;
 
   list_push_back(&frame_table_list, &fte->elem);
+  frame_used_cnt++;
   lock_release(&frame_table_lock);
 
+  if (evicted)
+  {
+    swap_flush();
+  }
   return frame_page;
 }
 
+/* Make FRAME, from allocate_frame(), a candidate for eviction.
+   Call once its page has been filled in and installed. */
+void frame_unpin(void *frame)
+{
+  lock_acquire(&frame_table_lock);
+  frame_lookup(frame)->pinned = false;
+  cond_broadcast(&evict_done, &frame_table_lock);
+  lock_release(&frame_table_lock);
+}
+
+/* Pin the frame holding SPTE's page, which belongs to the current
+   process, so that the page can be torn down without the pageout
+   daemon evicting it meanwhile, and return the frame.  Returns NULL
+   if the page is not in a frame.  is_loaded is checked under
+   frame_table_lock, once any eviction of the page has finished. */
+void *
+frame_pin(struct sup_page_table_entry *spte)
+{
+  void *frame = NULL;
+
+  lock_acquire(&frame_table_lock);
+  while (spte->evicting)
+  {
+    cond_wait(&evict_done, &frame_table_lock);
+  }
+  if (spte->is_loaded)
+  {
+    frame = pagedir_get_page(thread_current()->pagedir, spte->user_vaddr);
+    ASSERT(frame != NULL);
+    frame_lookup(frame)->pinned = true;
+  }
+  lock_release(&frame_table_lock);
+  return frame;
+}
+
+/* Wait until SPTE's page is not being evicted, so that its type and
+   is_loaded say where the page is. */
+void frame_wait_evicted(struct sup_page_table_entry *spte)
+{
+  lock_acquire(&frame_table_lock);
+  while (spte->evicting)
+  {
+    cond_wait(&evict_done, &frame_table_lock);
+  }
+  lock_release(&frame_table_lock);
+}
+
+/* Free FRAME and its frame table entry.  Does nothing if FRAME is NULL. */
 void frame_free(void *frame)
 {
-  struct list_elem *l_elem;
+  if (frame == NULL)
+  {
+    return;
+  }
 
   lock_acquire(&frame_table_lock);
-  for (l_elem = list_begin(&frame_table_list); l_elem != list_end(&frame_table_list);
-        l_elem = list_next(l_elem))
+  struct frame_table_entry *fte = frame_lookup(frame);
+  if (fte->owner != NULL)
+  {
+    clock_remove(fte);
+    fte->owner = NULL;
+    fte->spte = NULL;
+    palloc_free_page(frame);
+    cond_broadcast(&evict_done, &frame_table_lock);
+  }
+  lock_release(&frame_table_lock);
+}
+
+/* Prints frame table statistics. */
+void frame_print_stats(void)
+{
+  printf("Frames: %zu of %zu in use, %lld clock steps\n",
+         frame_used_cnt, frame_cnt, clock_step_cnt);
+  printf("Pageout: %lld frames freed by daemon, %lld evicted by faults\n",
+         pageout_cnt, direct_evict_cnt);
+  printf("Evictions: %lld (%lld dropped, %lld to file, %lld to swap)\n",
+         evict_cnt, evict_drop_cnt, evict_file_cnt, evict_swap_cnt);
+}
+
+/* Wake the pageout daemon, if it is not already awake.
+   frame_table_lock must be held. */
+static void
+pageout_wake(void)
+{
+  if (pageout_started && !pageout_wanted)
   {
-    struct frame_table_entry *fte = list_entry(l_elem, struct frame_table_entry, elem);
-    if (fte->frame == frame)
+    pageout_wanted = true;
+    sema_up(&pageout_sema);
+  }
+}
+
+/* Pageout daemon: each time it is woken, evicts one page at a time,
+   writing it out if needed, until pageout_high_water frames are
+   free.  frame_evict() drops frame_table_lock while it writes a page
+   out, so faults can be served meanwhile. */
+static void
+pageout_daemon(void *aux UNUSED)
+{
+  for (;;)
+  {
+    sema_down(&pageout_sema);
+    lock_acquire(&frame_table_lock);
+    pageout_wanted = false;
+    while (palloc_user_free_cnt() < pageout_high_water)
     {
-      list_remove(l_elem);
-      free(fte);
+      void *frame = frame_evict();
+      if (frame == NULL) //every frame is pinned
+      {
+        break;
+      }
       palloc_free_page(frame);
+      pageout_cnt++;
+    }
+    lock_release(&frame_table_lock);
+    swap_flush();
+  }
+}
+
+/* Evict the page in the frame chosen by the clock hand and return
+   the frame, which now belongs to the caller.  Returns NULL if
+   every frame in use is pinned.
+   frame_table_lock must be held.  It is released while the page is
+   written out, with the frame pinned and the page marked evicting,
+   so that other faults need not wait for the I/O.  File I/O takes
+   file_lock like the system calls do, and since file_lock comes
+   before frame_table_lock, it is taken before the page is marked,
+   so that nobody waiting for the eviction can be holding it. */
+static void *
+frame_evict(void)
+{
+  struct frame_table_entry *fte;
+  bool file_locked = false;
+
+  for (;;)
+  {
+    fte = clock_select();
+    if (fte == NULL || fte->spte->type != PAGE_MMAP || lock_held_by_current_thread(&file_lock))
+    {
       break;
     }
+    /* The frames may change while frame_table_lock is dropped, so
+       choose again once file_lock is held. */
+    lock_release(&frame_table_lock);
+    lock_acquire(&file_lock);
+    file_locked = true;
+    lock_acquire(&frame_table_lock);
+  }
+  if (fte == NULL)
+  {
+    if (file_locked)
+    {
+      lock_release(&file_lock);
+    }
+    return NULL;
+  }
+
+  /* Unmap the page before writing it out, so the owner faults
+     instead of changing it under us.  Only the owner's dirty bit
+     counts: the kernel writes through the frame's kernel alias only
+     to fill the frame in, which leaves the page clean. */
+  struct sup_page_table_entry *spte = fte->spte;
+  uint32_t *pd = fte->owner->pagedir;
+  if (pagedir_is_dirty(pd, fte->vaddr))
+  {
+    spte->dirty_bit = true;
   }
+  pagedir_clear_page(pd, fte->vaddr);
+  fte->pinned = true;
+  spte->evicting = true;
   lock_release(&frame_table_lock);
+
+  /* Only anonymous pages need swap.  The fault handler reloads file
+     and mmap pages from their files. */
+  long long *cnt;
+  if (spte->type == PAGE_MMAP) //write back to its file if dirty
+  {
+    if (spte->dirty_bit)
+    {
+      file_write_at(spte->file, fte->frame, spte->read_bytes, spte->offset);
+      spte->dirty_bit = false;
+      cnt = &evict_file_cnt;
+    }
+    else
+    {
+      cnt = &evict_drop_cnt;
+    }
+  }
+  else if (spte->type == PAGE_FILE && !spte->dirty_bit) //reread later
+  {
+    cnt = &evict_drop_cnt;
+  }
+  else //SWAP, or FILE changed since it was read: anonymous from now on
+  {
+    spte->type = PAGE_SWAP;
+    swap_out(fte);
+    cnt = &evict_swap_cnt;
+  }
+  if (file_locked)
+  {
+    lock_release(&file_lock);
+  }
+
+  lock_acquire(&frame_table_lock);
+  spte->is_loaded = false;
+  spte->evicting = false;
+  cond_broadcast(&evict_done, &frame_table_lock);
+
+  clock_remove(fte);
+  fte->owner = NULL;
+  fte->spte = NULL;
+  fte->pinned = false;
+  (*cnt)++;
+  evict_cnt++;
+  return fte->frame;
+}
+
+/* Second chance: move the hand around the frames, clearing the
+   accessed bits of frames used since the hand last passed, and
+   return the first unpinned frame that was not used.  Returns NULL
+   if CLOCK_REVOLUTIONS trips find nothing. */
+static struct frame_table_entry *
+clock_select(void)
+{
+  size_t steps = CLOCK_REVOLUTIONS * frame_used_cnt;
+  size_t i;
+
+  for (i = 0; i < steps; i++)
+  {
+    if (clock_hand == list_end(&frame_table_list))
+    {
+      clock_hand = list_begin(&frame_table_list);
+    }
+    struct frame_table_entry *fte = list_entry(clock_hand, struct frame_table_entry, elem);
+    clock_hand = list_next(clock_hand);
+    clock_step_cnt++;
+
+    if (!fte->pinned && !frame_referenced(fte))
+    {
+      return fte;
+    }
+  }
+  return NULL;
+}
+
+/* Returns true if some frame in use is pinned.
+   frame_table_lock must be held. */
+static bool
+frame_any_pinned(void)
+{
+  struct list_elem *e;
+
+  for (e = list_begin(&frame_table_list); e != list_end(&frame_table_list); e = list_next(e))
+  {
+    if (list_entry(e, struct frame_table_entry, elem)->pinned)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+/* Returns true if FTE's page was accessed since the hand last
+   passed, and clears its accessed bits.  The kernel reaches user
+   pages through their kernel virtual alias too, for example when
+   load_page_file() reads a page in, so the alias's bit counts as
+   well. */
+static bool
+frame_referenced(struct frame_table_entry *fte)
+{
+  uint32_t *pd = fte->owner->pagedir;
+  uint32_t *kpd = kernel_alias_pd();
+  bool accessed = pagedir_is_accessed(pd, fte->vaddr) || pagedir_is_accessed(kpd, fte->frame);
+
+  if (accessed)
+  {
+    pagedir_set_accessed(pd, fte->vaddr, false);
+    pagedir_set_accessed(kpd, fte->frame, false);
+  }
+  return accessed;
+}
+
+/* Take FTE off frame_table_list, moving the hand past it first. */
+static void
+clock_remove(struct frame_table_entry *fte)
+{
+  if (clock_hand == &fte->elem)
+  {
+    clock_hand = list_next(clock_hand);
+  }
+  list_remove(&fte->elem);
+  frame_used_cnt--;
+}
+
+/* Kernel virtual addresses are mapped by page tables shared by
+   every page directory.  Returns the active page directory, so
+   that clearing a kernel alias's bits also flushes the TLB. */
+static uint32_t *
+kernel_alias_pd(void)
+{
+  uint32_t *pd = thread_current()->pagedir;
+  return pd != NULL ? pd : base_page_dir;
 }
@@ -9,22 +9,36 @@
 #include "vm/swap.h"
 #include "threads/palloc.h"
 
+/* One entry per page in the user pool, indexed by
+   palloc_user_page_idx(), so the entry for a frame is found
+   without searching. */
 struct frame_table_entry
 {
 	uint32_t* frame;
 	uint32_t* vaddr;
-	struct thread* owner;
+	struct thread* owner; // NULL while the frame is free
 	struct sup_page_table_entry* spte;
+	bool pinned; // being filled in, so not to be evicted
 
-	struct list_elem elem; //for frame_tables list
+	struct list_elem elem; //for frame_table_list, frames in use
 };
 
-struct lock frame_table_lock;
-struct list frame_table_list;
+extern struct lock frame_table_lock;
+extern struct list frame_table_list;
+
+/* Free frame watermarks for the pageout daemon. */
+extern size_t pageout_low_water;
+extern size_t pageout_high_water;
 
 
 void frame_init (void);
+void frame_start_pageout (void);
 void frame_free(void *frame);
-void* allocate_frame (void *addr, enum palloc_flags flags);
+void frame_unpin(void *frame);
+void *frame_pin(struct sup_page_table_entry *spte);
+void frame_wait_evicted(struct sup_page_table_entry *spte);
+void* allocate_frame (struct sup_page_table_entry *spte, enum palloc_flags flags);
+struct frame_table_entry *frame_lookup (void *frame);
+void frame_print_stats (void);
 
 #endif /* vm/frame.h */
@@ -1,6 +1,17 @@
 #include "vm/page.h"
 #include "userprog/process.h"
 
+struct kmem_cache *spte_cache;
+struct kmem_cache *mmap_file_cache;
+
+/* Create the object caches for sptes and mmap_files. */
+/* Called once at boot. */
+void page_slab_init(void)
+{
+  spte_cache = kmem_cache_create("spte", sizeof(struct sup_page_table_entry), NULL);
+  mmap_file_cache = kmem_cache_create("mmap_file", sizeof(struct mmap_file), NULL);
+}
+
 /* Initialize supplementary page table. */
 /* Given in skeleton. */
 /* Init when a process starts. */
@@ -37,7 +48,7 @@ page_less_func(const struct hash_elem *a, const struct hash_elem *b)
 struct sup_page_table_entry *
 allocate_page(void *addr, struct file *file, off_t ofs, uint32_t read_bytes, uint32_t zero_bytes, bool writable)
 {
-  struct sup_page_table_entry *spte = malloc(sizeof(struct sup_page_table_entry));
+  struct sup_page_table_entry *spte = kmem_cache_alloc(spte_cache);
 
   if (spte == NULL)
   {
@@ -49,10 +60,12 @@ allocate_page(void *addr, struct file *file, off_t ofs, uint32_t read_bytes, uin
   spte->file = file;
   spte->writable = writable;
   spte->is_loaded = false;
+  spte->evicting = false;
   spte->read_bytes = read_bytes;
   spte->zero_bytes = zero_bytes;
   spte->offset = ofs;
-  spte->type=0;
+  spte->type = PAGE_FILE;
+  spte->dirty_bit = false;
   spte->accessed_bit=false;
 
   hash_insert(&thread_current()->page_table, &spte->hash_elem); //hash 에 elem 넣어주기
@@ -70,7 +83,7 @@ stack_growth (void * uv_addr)
       return false;
   }
   // Create spte. //
-  struct sup_page_table_entry *spte = malloc(sizeof(struct sup_page_table_entry));
+  struct sup_page_table_entry *spte = kmem_cache_alloc(spte_cache);
   if (spte == NULL)
   {
     return false;
@@ -78,23 +91,26 @@ stack_growth (void * uv_addr)
     // Setup spte. //
     spte->user_vaddr = pg_round_down(uv_addr);
     spte->is_loaded = true;
+    spte->evicting = false;
     spte->writable = true;
-    spte->type = 1;
+    spte->type = PAGE_SWAP;
+    spte->dirty_bit = false;
     spte->accessed_bit = true;
   //allocate frame //
-  uint8_t *frame = allocate_frame (spte->user_vaddr, PAL_USER);
+  uint8_t *frame = allocate_frame (spte, PAL_USER);
   if (!frame) //if failed alllocation
     {
-      free(spte);
+      kmem_cache_free(spte_cache, spte);
       return false;
     }
   // install page //
   if (!install_page(spte->user_vaddr, frame, spte->writable))
     {
-      free(spte);
+      kmem_cache_free(spte_cache, spte);
       frame_free(frame);
       return false;
     }
+  frame_unpin(frame);
 
   // if (intr_context())
   //   {
@@ -162,12 +178,13 @@ remove_spte(struct hash *spt, struct sup_page_table_entry *spte)
 void spt_destructor(struct hash_elem *elem)
 {
   struct sup_page_table_entry *spte = hash_entry(elem, struct sup_page_table_entry, hash_elem);
-  if (spte->is_loaded)
+  void *frame = frame_pin(spte); //keep the daemon off it
+  if (frame != NULL)
     {
-      frame_free(pagedir_get_page(thread_current()->pagedir, spte->user_vaddr));
       pagedir_clear_page(thread_current()->pagedir, spte->user_vaddr);
+      frame_free(frame);
     }
-  free(spte);
+  kmem_cache_free(spte_cache, spte);
 }
 
 /* Remove(destory) the spt. */
@@ -186,20 +203,31 @@ bool load_page_file(struct sup_page_table_entry *spte)
   {
     return false;
   }
-  file_seek(spte->file, spte->offset);
-  void *frame_page = allocate_frame(spte->user_vaddr,PAL_USER);
+  void *frame_page = allocate_frame(spte,PAL_USER);
   if (frame_page != NULL)
   {
-    if (file_read(spte->file, frame_page, spte->read_bytes) == (int)spte->read_bytes)
+    // a fault in the middle of a file system call already holds file_lock
+    bool held = lock_held_by_current_thread(&file_lock);
+    if (!held)
+    {
+      lock_acquire(&file_lock);
+    }
+    off_t bytes_read = file_read_at(spte->file, frame_page, spte->read_bytes, spte->offset);
+    if (!held)
+    {
+      lock_release(&file_lock);
+    }
+    if (bytes_read == (int)spte->read_bytes)
     {
       memset(frame_page + spte->read_bytes, 0, spte->zero_bytes);
       /* Adds a mapping from user virtual address UPAGE to kernel
            virtual address KPAGE to the page table.*/
       install_page(spte->user_vaddr, frame_page, spte->writable);
       spte->is_loaded = true; //FIXME:
+      frame_unpin(frame_page);
       return true;
     }
-    //TODO: else frame free 해줘야됨
+    frame_free(frame_page);
   }
 
   return false;
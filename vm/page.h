@@ -18,6 +18,7 @@
 #include "threads/interrupt.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/slab.h"
 
 #include "userprog/pagedir.h"
 #include "userprog/process.h"
@@ -25,17 +26,26 @@
 
 #define MAX_STACK_SIZE (1 << 23) /* 8MB */
 
+/* Where a page's contents are kept while it is not in a frame. */
+enum page_type
+{
+	PAGE_FILE,	/* In its file, until it is changed. */
+	PAGE_SWAP,	/* In swap: stack pages and changed FILE pages. */
+	PAGE_MMAP	/* In its file, written back when changed. */
+};
+
 struct sup_page_table_entry
 {
 	uint32_t* user_vaddr;
 	uint64_t access_time;
 
-	int type; // 0:FILE  1:SWAP  2:MMAP //TODO: change to enum for readability
+	enum page_type type;
 
 	bool dirty_bit;
 	bool accessed_bit;
 	bool writable;
 	bool is_loaded;
+	bool evicting; // being written out; is_loaded until it is done
 
 	uint32_t read_bytes; // page에 쓰여져 있는 데이터 크기
 	uint32_t zero_bytes; // 남은 페이지의 크기, 0으로 채우려고
@@ -56,6 +66,11 @@ struct mmap_file
 	struct list mmap_sptes; /* List of sptes corresponding to the mmapped file. */
 };
 
+/* Object caches for sptes and mmap_files. */
+extern struct kmem_cache *spte_cache;
+extern struct kmem_cache *mmap_file_cache;
+
+void page_slab_init (void);
 void page_init (struct hash *spt);
 struct sup_page_table_entry *allocate_page (void *addr, struct file *file, off_t ofs, uint32_t read_bytes, uint32_t zero_bytes, bool writable);
 
@@ -1,8 +1,16 @@
 #include "vm/swap.h"
 #include "devices/disk.h"
 #include "threads/synch.h"
+#include "threads/tsc.h"
 #include <bitmap.h>
+#include <stdio.h>
+#include <string.h>
 
+/* Sectors in one swap slot. */
+#define SECTORS_PER_PAGE (PGSIZE / DISK_SECTOR_SIZE)
+
+/* Most pages written to swap by one disk command. */
+#define SWAP_CLUSTER 8
 
 /* The swap device */
 static struct disk *swap_device;
@@ -10,9 +18,26 @@ static struct disk *swap_device;
 /* Tracks in-use and free swap slots */
 static struct bitmap *swap_table;
 
-/* Protects swap_table */
+/* Protects swap_table and the cluster */
 static struct lock swap_lock;
 
+/* Cluster: pages evicted one after another are copied here and
+   given consecutive slots of a run reserved on the swap disk, so
+   that they can be written with a single command. */
+static uint8_t *cluster_buf;     /* SWAP_CLUSTER pages. */
+static size_t cluster_start;     /* First slot of the reserved run. */
+static size_t cluster_slots;     /* Slots reserved in the run. */
+static size_t cluster_cnt;       /* Pages in cluster_buf. */
+
+/* Statistics. */
+static long long swap_out_cnt;   /* Pages written to swap. */
+static long long swap_write_cnt; /* Clusters written. */
+static long long swap_in_cnt;    /* Pages read from swap. */
+static uint64_t swap_out_cycles; /* Time spent writing. */
+static uint64_t swap_in_cycles;  /* Time spent reading. */
+
+static void cluster_flush(void);
+
 /*
  * Initialize swap_device, swap_table, and swap_lock.
  */
@@ -25,6 +50,7 @@ swap_init (void)
   swap_table = bitmap_create(disk_size(swap_device)/(PGSIZE/DISK_SECTOR_SIZE));
   bitmap_set_all(swap_table, 0);
   lock_init(&swap_lock);
+  cluster_buf = palloc_get_multiple(PAL_ASSERT, SWAP_CLUSTER);
 }
 
 /*
@@ -43,7 +69,7 @@ bool
 swap_in (void *addr)
 {
   struct sup_page_table_entry * spte = find_spte(&thread_current()->page_table, addr);
-  uint8_t *frame = allocate_frame(addr, PAL_USER);
+  uint8_t *frame = allocate_frame(spte, PAL_USER);
   if(!install_page(spte->user_vaddr, frame, spte->writable))
   {
     frame_free(frame);
@@ -51,76 +77,64 @@ swap_in (void *addr)
   }
   read_from_disk(frame, spte->swap_index);
   spte->is_loaded = true;
+  frame_unpin(frame);
   return true;
 }
 
 /*
- * Evict a frame to swap device.
- * 1. Choose the frame you want to evict.
- * (Ex. Least Recently Used policy -> Compare the timestamps when each
- * frame is last accessed)
- * 2. Evict the frame. Unlink the frame from the supplementray page table entry
- * Remove the frame from the frame table after freeing the frame with
- * pagedir_clear_page.
- * 3. Do NOT delete the supplementary page table entry. The process
+ * Write the page in a frame chosen for eviction to the swap device.
+ * The frame has already been unmapped from its owner by frame_evict()
+ * in vm/frame.c, which chooses the victim with the clock algorithm
+ * and calls this only for anonymous (SWAP) pages.
+ * 1. Do NOT delete the supplementary page table entry. The process
  * should have the illusion that they still have the page allocated to
  * them.
- * 4. Find a free block to write you data. Use swap table to get track
+ * 2. Find a free block to write you data. Use swap table to get track
  * of in-use and free swap slots.
+ * The page is copied into the cluster, so the frame may be reused at
+ * once, but it reaches the disk only when the cluster fills up or
+ * swap_flush() is called.
+ * The frame must be pinned.
  */
-void *
-swap_out (enum palloc_flags flags)
+void
+swap_out (struct frame_table_entry *fte)
 {
-  lock_acquire(&frame_table_lock);
-  struct list_elem *frame_elem;
-  void* addr;
-  while(true)
+  struct sup_page_table_entry *spte = fte->spte;
+
+  lock_acquire(&swap_lock);
+  if(cluster_slots == 0)
   {
-    for (frame_elem = list_begin(&frame_table_list); frame_elem != list_end(&frame_table_list); frame_elem = list_next(frame_elem))
+    //reserve a run of free slots, or at least one
+    cluster_slots = SWAP_CLUSTER;
+    cluster_start = bitmap_scan_and_flip(swap_table, 0, cluster_slots, false);
+    if(cluster_start == BITMAP_ERROR)
     {
-      struct frame_table_entry *fte = list_entry(frame_elem, struct frame_table_entry, elem);
-      //uint32_t ft_pagedir = fte->owner->pagedir;
-      //uint8_t uvaddr = fte->spte->user_vaddr;
-      if(! fte->spte->accessed_bit && pagedir_is_accessed(fte->owner->pagedir, fte->spte->user_vaddr))
-      {
-        pagedir_set_accessed(fte->owner->pagedir, fte->spte->user_vaddr, false);
-      }
-      else if(! fte->spte->accessed_bit)
-      {
-        if(pagedir_is_dirty(fte->owner->pagedir, fte->spte->user_vaddr) || fte->spte->type == 1)
-        {
-          if(fte->spte->type == 0)
-          {
-            fte->spte->type = 1;
-          }
-          if(fte->spte->type == 2)
-          {
-            file_write_at(fte->spte->file,fte->spte->user_vaddr, fte->spte->read_bytes, fte->spte->offset);
-          }
-        }
-
-        //find first 0 bit  and  flip it
-        int free_index = bitmap_scan_and_flip(swap_table, 0, 1, 0);
-
-        fte->spte->swap_index = write_to_disk((uint8_t*)fte->frame, free_index);
-
-        fte->spte->is_loaded = false;
-        list_remove(&fte->elem);
-        lock_release(&frame_table_lock);
-        pagedir_clear_page(fte->owner->pagedir, fte->spte->user_vaddr);
-        palloc_free_page(fte->frame);
-        free(fte);
-
-
-        addr = palloc_get_page(flags);
-        if(addr) break;
-      }
+      cluster_slots = 1;
+      cluster_start = bitmap_scan_and_flip(swap_table, 0, cluster_slots, false);
+    }
+    if(cluster_start == BITMAP_ERROR)
+    {
+      PANIC("swap is full");
     }
-    return addr;
   }
 
+  memcpy(cluster_buf + cluster_cnt * PGSIZE, fte->frame, PGSIZE);
+  spte->swap_index = cluster_start + cluster_cnt;
+  cluster_cnt++;
+  if(cluster_cnt == cluster_slots)
+  {
+    cluster_flush();
+  }
+  lock_release(&swap_lock);
+}
 
-
+/* Write out any pages waiting in the cluster. */
+void
+swap_flush (void)
+{
+  lock_acquire(&swap_lock);
+  cluster_flush();
+  lock_release(&swap_lock);
 }
 
 /*
@@ -130,26 +144,48 @@ swap_out (enum palloc_flags flags)
 void read_from_disk (uint8_t *frame, int index)
 {
   lock_acquire(&swap_lock);
-  int i=0;
-  while(i<8)
-  {
-      disk_read(swap_device, index * 8 + 1, (uint8_t*)frame + i * DISK_SECTOR_SIZE);
-      i++;
-  }
+  cluster_flush(); //the page may still be waiting to be written
+  uint64_t start = rdtsc();
+  disk_read_multiple(swap_device, index * SECTORS_PER_PAGE, frame, SECTORS_PER_PAGE);
+  swap_in_cycles += rdtsc() - start;
+  swap_in_cnt++;
   bitmap_flip(swap_table, index);
   lock_release(&swap_lock);
 }
 
-/* Write data to swap device from frame */
-int write_to_disk (uint8_t *frame, int index)
+/* Prints swap statistics. */
+void
+swap_print_stats (void)
 {
-  lock_acquire(&swap_lock);
-  int i;
-  for (i=0; i<(PGSIZE/DISK_SECTOR_SIZE);i++)
+  printf("Swap: %lld pages out in %lld writes, %lld pages in\n",
+         swap_out_cnt, swap_write_cnt, swap_in_cnt);
+  if(swap_out_cnt > 0 && swap_in_cnt > 0)
   {
-    disk_write(swap_device, index * (PGSIZE/DISK_SECTOR_SIZE) + i, (uint8_t*) frame + i * DISK_SECTOR_SIZE);
+    printf("Swap: %llu cycles per page out, %llu per page in\n",
+           (unsigned long long) (swap_out_cycles / swap_out_cnt),
+           (unsigned long long) (swap_in_cycles / swap_in_cnt));
   }
-  lock_release(&swap_lock);
-  return index;
+}
 
+/* Write the pages in the cluster to their slots with one command,
+   and give back the slots reserved for it that went unused.
+   swap_lock must be held. */
+static void
+cluster_flush (void)
+{
+  if(cluster_cnt > 0)
+  {
+    uint64_t start = rdtsc();
+    disk_write_multiple(swap_device, cluster_start * SECTORS_PER_PAGE, cluster_buf,
+                        cluster_cnt * SECTORS_PER_PAGE);
+    swap_out_cycles += rdtsc() - start;
+    swap_out_cnt += cluster_cnt;
+    swap_write_cnt++;
+  }
+  if(cluster_slots > cluster_cnt)
+  {
+    bitmap_set_multiple(swap_table, cluster_start + cluster_cnt, cluster_slots - cluster_cnt, false);
+  }
+  cluster_cnt = 0;
+  cluster_slots = 0;
 }
@@ -21,10 +21,13 @@
 #include "userprog/process.h"
 #include "userprog/syscall.h"
 
+struct frame_table_entry;
+
 void swap_init (void);
 bool swap_in (void *addr);
-void * swap_out (enum palloc_flags flags);
+void swap_out (struct frame_table_entry *fte);
+void swap_flush (void);
 void read_from_disk (uint8_t *frame, int index);
-int write_to_disk (uint8_t *frame, int index);
+void swap_print_stats (void);
 
 #endif /* vm/swap.h */